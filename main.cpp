@@ -1,91 +1,442 @@
-﻿#include "platform/bp_opencl_platform.h"
+﻿#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include "platform/bp_opencl_platform.h"
 #include "runtime/bp_opencl_runtime.h"
 #include "runtime/bp_opencl_runtime_memory.h"
+#include "runtime/bp_opencl_runtime_precision.h"
+#include "runtime/bp_opencl_runtime_roofline.h"
+#include "runtime/bp_opencl_runtime_batch.h"
+#include "runtime/bp_opencl_runtime_tiling.h"
+#include "runtime/bp_opencl_runtime_sort.h"
+#include "runtime/bp_opencl_runtime_gemm.h"
+#include "runtime/bp_opencl_runtime_capture.h"
+#include "runtime/bp_opencl_runtime_residency.h"
+#include "runtime/bp_opencl_runtime_executor.h"
 #include "utils/bp_opencl_common.h"
 
 std::vector<std::string> kernel_funcs{
-    "__kernel void float_func(__global const float* in, __global float* out)\n"
+    "__kernel void float_func(__global const float* in, __global float* out, ulong count)\n"
     "{\n"
-    "\tint tid = get_global_id(0);\n"
+    "\tsize_t tid = get_global_id(0) - get_global_offset(0);\n"
+    "\tif (tid >= count) {\n"
+    "\t\treturn;\n"
+    "\t}\n"
     "\tout[tid] = in[tid * 3] * in[tid * 3 + 1] + in[tid * 3 + 2];\n"
     "}",
-    "__kernel void double_func(__global const double* in, __global double* out)\n"
+    "__kernel void float_batch_func(__global const float* in, __global float* out,\n"
+    "\t__global const uint* offsets, uint num_requests)\n"
     "{\n"
     "\tint tid = get_global_id(0);\n"
+    "\tif (tid >= offsets[num_requests]) {\n"
+    "\t\treturn;\n"
+    "\t}\n"
     "\tout[tid] = in[tid * 3] * in[tid * 3 + 1] + in[tid * 3 + 2];\n"
+    "}",
+    "__kernel void float_chain_func(__global const float* in, __global float* out, ulong count)\n"
+    "{\n"
+    "\tsize_t tid = get_global_id(0) - get_global_offset(0);\n"
+    "\tif (tid >= count) {\n"
+    "\t\treturn;\n"
+    "\t}\n"
+    "\tout[tid] = out[tid] * in[tid * 3] + in[tid * 3 + 2];\n"
+    "}"
+};
+
+// Built separately since image types only compile on devices with image support.
+std::vector<std::string> image_kernel_funcs{
+    "__kernel void image_box_func(__read_only image2d_t in, sampler_t sampler, __global float* out, int width)\n"
+    "{\n"
+    "\tint x = get_global_id(0);\n"
+    "\tint y = get_global_id(1);\n"
+    "\tfloat sum = 0.0f;\n"
+    "\tfor (int dy = -1; dy <= 1; ++dy) {\n"
+    "\t\tfor (int dx = -1; dx <= 1; ++dx) {\n"
+    "\t\t\tsum += read_imagef(in, sampler, (int2)(x + dx, y + dy)).x;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\tout[y * width + x] = sum / 9.0f;\n"
     "}"
 };
 
 std::vector<std::string> kernel_names{
     "float_func",
-    "double_func"
+    "float_batch_func",
+    "float_chain_func"
 };
 
-int main()
+// Bytes moved and flops per work item of each kernel, used by the roofline report.
+std::vector<runtime::roofline::bp_kernel_cost> kernel_costs{
+    { "float_func", sizeof(float) * 4, 2, false }
+};
+
+// Replays on every device what the same platform and device recorded, or only on the chosen one. Devices that
+// can't run the capture, such as ones that can't build its programs, are skipped unless they were chosen.
+static void replay_capture(const platform::bp_platform& bp_platform, const std::string& path, bool pick_device,
+    size_t platform_index, size_t device_index)
+{
+    runtime::executor::bp_executor bp_executor{ bp_platform };
+    auto replay = [&path](const runtime::executor::bp_worker_device& worker) {
+        runtime::capture::bp_replay bp_replay{ worker.context, worker.device, worker.platform_index,
+            worker.device_index };
+        bp_replay.run(worker.command_queue, path);
+    };
+
+    // One device at a time, so replayed times aren't disturbed by the other devices.
+    size_t num_replayed = 0;
+    for (size_t i = 0; i < bp_executor.get_worker_number(); ++i) {
+        const auto& worker = bp_executor.get_worker_device(i);
+        if (pick_device) {
+            if (worker.platform_index == platform_index && worker.device_index == device_index) {
+                bp_executor.run_on(i, replay);
+                ++num_replayed;
+            }
+            continue;
+        }
+        auto replayed = bp_executor.submit(i, replay);
+        try {
+            replayed.get();
+            ++num_replayed;
+        } catch (const bp_error& error) {
+            bp_print_info(true, "Skip replay on platform ", worker.platform_index, " device ", worker.device_index,
+                ": ", error.what());
+        }
+    }
+    bp_validate_condition(!pick_device || num_replayed == 1, "Replay device doesn't exist.");
+    bp_print_info(true, "Replayed on ", num_replayed, " devices.");
+}
+
+// Runs TEST_SCALING_ELEMENTS float items in chunks on the first device alone, then on all devices at once,
+// every worker taking the next chunk when it is done, and compares the wall times.
+static void measure_scaling(runtime::executor::bp_executor& bp_executor,
+    const runtime::memory::bp_transfer_policy& bp_transfer_policy)
+{
+    size_t num_worker = bp_executor.get_worker_number();
+    auto in(std::make_unique<float[]>(TEST_SCALING_ELEMENTS * 3));
+    auto out(std::make_unique<float[]>(TEST_SCALING_ELEMENTS));
+    fill_random_data<float>(in.get(), TEST_SCALING_ELEMENTS * 3, 127.0f, -128.0f);
+
+    // Kernels are built before timing, one per worker.
+    std::vector<std::unique_ptr<runtime::bp_program>> programs(num_worker);
+    std::vector<std::unique_ptr<runtime::bp_kernel>> kernels(num_worker);
+    std::vector<cl_kernel> float_kernels(num_worker);
+    bp_executor.run_on_all([&](const runtime::executor::bp_worker_device& worker) {
+        programs[worker.worker_index] = std::make_unique<runtime::bp_program>();
+        kernels[worker.worker_index] = std::make_unique<runtime::bp_kernel>();
+        cl_program program = programs[worker.worker_index]->create_program_with_source(worker.context, kernel_funcs,
+            std::vector<cl_device_id>{ worker.device });
+        float_kernels[worker.worker_index] = kernels[worker.worker_index]->create_kernel(program, kernel_names[0]);
+    });
+
+    size_t chunk_items = (TEST_SCALING_ELEMENTS + TEST_SCALING_CHUNKS - 1) / TEST_SCALING_CHUNKS;
+    std::atomic<size_t> next_chunk{ 0 };
+    std::vector<size_t> worker_chunks(num_worker);
+    auto run_chunks = [&](const runtime::executor::bp_worker_device& worker) {
+        runtime::tiling::bp_tiled_executor bp_tiled_executor{ worker.context, worker.device, worker.command_queue,
+            bp_transfer_policy };
+        for (size_t chunk = next_chunk++; chunk < TEST_SCALING_CHUNKS; chunk = next_chunk++) {
+            size_t first = chunk * chunk_items;
+            size_t items = std::min(chunk_items, TEST_SCALING_ELEMENTS - first);
+            bp_tiled_executor.run(float_kernels[worker.worker_index], { { in.get() + first * 3, sizeof(float) * 3 } },
+                { { out.get() + first, sizeof(float) } }, items);
+            ++worker_chunks[worker.worker_index];
+        }
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    bp_executor.run_on(0, run_chunks);
+    auto single_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+
+    next_chunk = 0;
+    std::fill(worker_chunks.begin(), worker_chunks.end(), 0);
+    begin = std::chrono::steady_clock::now();
+    bp_executor.run_on_all(run_chunks);
+    auto all_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+
+    for (size_t n = 0; n < TEST_SCALING_ELEMENTS; ++n) {
+        float expected = in[n * 3] * in[n * 3 + 1] + in[n * 3 + 2];
+        bp_validate_condition(std::abs(out[n] - expected) <= 1e-3f * std::max(1.0f, std::abs(expected)),
+            "Scaling job result is wrong.");
+    }
+    for (size_t i = 0; i < num_worker; ++i) {
+        bp_print_info(true, "Worker ", i, " ran ", worker_chunks[i], " of ", TEST_SCALING_CHUNKS, " chunks.");
+    }
+    bp_print_info(true, "Scaling job took ", single_time.count(), " ms on one device, ", all_time.count(), " ms on ",
+        num_worker, " devices, speedup ", all_time.count() == 0 ? 0.0 :
+        static_cast<double>(single_time.count()) / all_time.count());
+}
+
+// Counts and indices are plain decimal numbers, anything else is reported instead of thrown.
+static size_t parse_size(const std::string& arg, const std::string& name)
+{
+    bool digits = !arg.empty();
+    for (char c : arg) {
+        digits = digits && c >= '0' && c <= '9';
+    }
+    bp_validate_condition(digits, name + " must be an unsigned integer: " + arg);
+
+    errno = 0;
+    unsigned long long value = std::strtoull(arg.c_str(), nullptr, 10);
+    bp_validate_condition(errno != ERANGE && value <= SIZE_MAX, name + " is too large: " + arg);
+    return static_cast<size_t>(value);
+}
+
+int main(int argc, char* argv[])
 {
+    // The float test size can be given at runtime, jobs beyond the device limits are tiled.
+    // --capture records the run to a file, --replay re-executes a recorded run instead, on every device or
+    // on the one --replay-device platform,device names.
+    size_t num_elements = TEST_GLOBAL_SIZE_X;
+    std::string capture_path{};
+    std::string replay_path{};
+    bool pick_replay_device = false;
+    size_t replay_platform = 0;
+    size_t replay_device = 0;
+    auto capture_contents = runtime::capture::bp_capture_contents::full;
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg{ argv[i] };
+        if (arg == "--capture" || arg == "--capture-contents" || arg == "--replay" || arg == "--replay-device") {
+            bp_validate_condition(i + 1 < argc, arg + " needs a value.");
+            std::string value{ argv[++i] };
+            if (arg == "--capture") {
+                capture_path = value;
+            } else if (arg == "--capture-contents") {
+                capture_contents = runtime::capture::get_capture_contents(value);
+            } else if (arg == "--replay") {
+                replay_path = value;
+            } else {
+                size_t comma = value.find(',');
+                bp_validate_condition(comma != std::string::npos, arg + " needs platform,device.");
+                pick_replay_device = true;
+                replay_platform = parse_size(value.substr(0, comma), "Replay platform");
+                replay_device = parse_size(value.substr(comma + 1), "Replay device");
+            }
+        } else {
+            num_elements = parse_size(arg, "Element number");
+        }
+    }
+    bp_validate_condition(num_elements != 0, "Element number must be positive.");
+
     // Get all platforms.
     platform::bp_platform bp_platform{};
     size_t num_platform = bp_platform.get_number();
-    for (auto i = 0; i < num_platform; ++i) {
+
+    if (!replay_path.empty()) {
+        replay_capture(bp_platform, replay_path, pick_replay_device, replay_platform, replay_device);
+        return 0;
+    }
+    if (!capture_path.empty()) {
+        runtime::capture::start_capture(capture_path, capture_contents);
+    }
+
+    for (size_t i = 0; i < num_platform; ++i) {
         bp_print_info(true, "Platform ", i);
-        cl_platform_id platform = bp_platform.get_ith(i);
-        bp_platform.print_info(platform);
+        bp_platform.print_info(bp_platform.get_ith(i));
+    }
+
+    // Transfer strategies are probed once per device and driver, then reused from the cache file.
+    runtime::memory::bp_transfer_policy bp_transfer_policy{};
 
-        // Get all devices on this platform.
-        platform::bp_device bp_device{ platform };
+    // One worker per device, devices of all platforms run at the same time.
+    runtime::executor::bp_executor bp_executor{ bp_platform };
 
-        // Use platform and devices to create context.
-        platform::bp_context bp_context{ platform, bp_device };
+    // Create float test objects, their buffers are created per device and tile.
+    auto float_in(std::make_unique<float[]>(num_elements * 3));
+    fill_random_data<float>(float_in.get(), num_elements * 3, 127.0f, -128.0f);
 
-        // Use context and devices to create program.
+    // Create double test objects, the precision policy owns the buffers of each variant.
+    auto double_in(std::make_unique<double[]>(TEST_GLOBAL_SIZE_X * 3));
+    fill_random_data<double>(double_in.get(), TEST_GLOBAL_SIZE_X * 3, 127.0, -128.0);
+
+    auto run_device = [&](const runtime::executor::bp_worker_device& worker) {
+        cl_context context = worker.context;
+        cl_device_id device = worker.device;
+        // Float and double jobs share the queue the executor created for this device.
+        cl_command_queue command_queue = worker.command_queue;
+        bp_print_info(true, "Platform ", worker.platform_index, " device ", worker.device_index);
+        bp_executor.get_platform_devices(worker.platform_index).print_info(device);
+
+        // Programs and kernels are per worker, kernel arguments can't be shared between threads.
         runtime::bp_program bp_program{};
-        cl_program program = bp_program.create_program_with_source(bp_context.get(), kernel_funcs, bp_device);
+        cl_program program = bp_program.create_program_with_source(context, kernel_funcs,
+            std::vector<cl_device_id>{ device });
 
-        // Create float and double test kernels.
+        // Create float test kernel.
         runtime::bp_kernel bp_kernel{};
-        std::vector<cl_kernel> cl_kernels{};
         cl_kernel float_kernel = bp_kernel.create_kernel(program, kernel_names[0]);
-        cl_kernel double_kernel = bp_kernel.create_kernel(program, kernel_names[1]);
+        cl_kernel float_batch_kernel = bp_kernel.create_kernel(program, kernel_names[1]);
+        cl_kernel float_chain_kernel = bp_kernel.create_kernel(program, kernel_names[2]);
 
-        runtime::memory::bp_memory bp_memory{};
-        cl_context context = bp_context.get();
-
-        // Create float test objects and set to kernel.
-        auto float_in(std::make_unique<float[]>(TEST_GLOBAL_SIZE_X * 3));
-        auto float_out(std::make_unique<float[]>(TEST_GLOBAL_SIZE_X));
-        fill_random_data<float>(float_in.get(), TEST_GLOBAL_SIZE_X * 3, 127.0f, -128.0f);
-        cl_mem float_in_mem = bp_memory.create_buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
-            TEST_GLOBAL_SIZE_X * 3, float_in.get());
-        cl_mem float_out_mem = bp_memory.create_buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
-            TEST_GLOBAL_SIZE_X, float_out.get());
-        runtime::set_args(float_kernel, 0, std::pair<cl_mem*, size_t>(&float_in_mem, sizeof(cl_mem)),
-            std::pair<cl_mem*, size_t>(&float_out_mem, sizeof(cl_mem)));
-
-        // Create float test objects and set to kernel.
-        auto double_in(std::make_unique<double[]>(TEST_GLOBAL_SIZE_X * 3));
+        // Double test kernels fall back to emulation on devices with missing or slow fp64.
+        runtime::precision::bp_precision_policy bp_precision{ context, std::vector<cl_device_id>{ device },
+            DOUBLE_ACCURACY_BUDGET };
+
+        auto float_out(std::make_unique<float[]>(num_elements));
         auto double_out(std::make_unique<double[]>(TEST_GLOBAL_SIZE_X));
-        fill_random_data<double>(double_in.get(), TEST_GLOBAL_SIZE_X * 3, 127.0, -128.0);
-        cl_mem double_in_mem = bp_memory.create_buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
-            TEST_GLOBAL_SIZE_X * 3, double_in.get());
-        cl_mem double_out_mem = bp_memory.create_buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
-            TEST_GLOBAL_SIZE_X, double_out.get());
-        runtime::set_args(double_kernel, 0, std::pair<cl_mem*, size_t>(&double_in_mem, sizeof(cl_mem)),
-            std::pair<cl_mem*, size_t>(&double_out_mem, sizeof(cl_mem)));
-
-        size_t num_device = bp_device.get_number();
-        for (auto j = 0; j < num_device; ++j) {
-            bp_print_info(true, "Device ", j);
-            cl_device_id device = bp_device.get_ith(j);
-            bp_device.print_info(device);
-
-            // Create command queue on this device.
-            runtime::bp_cmdqueue bp_cmdqueue{};
-            cl_command_queue command_queue_float = bp_cmdqueue.create_command_queue(context, device);
-            bp_cmdqueue.enqueue_kernel(command_queue_float, float_kernel);
-            cl_command_queue command_queue_double = bp_cmdqueue.create_command_queue(context, device);
-            bp_cmdqueue.enqueue_kernel(command_queue_double, double_kernel);
+
+        runtime::roofline::bp_roofline bp_roofline{};
+        runtime::bp_cmdqueue bp_cmdqueue{};
+
+        // Run the float kernel in tiles that fit the device, with the fastest transfer strategy of this device.
+        bp_transfer_policy.probe(context, device, command_queue);
+        runtime::tiling::bp_tiled_executor bp_tiled_executor{ context, device, command_queue, bp_transfer_policy };
+        cl_ulong float_time = bp_tiled_executor.run(float_kernel, { { float_in.get(), sizeof(float) * 3 } },
+            { { float_out.get(), sizeof(float) } }, num_elements);
+        bp_roofline.add_sample(device, kernel_costs[0], num_elements, float_time);
+        runtime::memory::bp_memory bp_memory{};
+        auto double_report = bp_precision.run(device, command_queue, double_in.get(), double_out.get(),
+            TEST_GLOBAL_SIZE_X);
+        bp_roofline.add_sample(device, runtime::precision::get_precision_mode_cost(double_report.mode),
+            TEST_GLOBAL_SIZE_X, double_report.elapsed_time);
+
+        // Run a 2D box stencil through the texture cache, the image size isn't a multiple of the local size.
+        if (platform::get_device_info_single_type<cl_bool>(device, CL_DEVICE_IMAGE_SUPPORT) == CL_TRUE) {
+            runtime::bp_program bp_image_program{};
+            runtime::bp_kernel bp_image_kernel{};
+            cl_program image_program = bp_image_program.create_program_with_source(context, image_kernel_funcs,
+                std::vector<cl_device_id>{ device });
+            cl_kernel image_kernel = bp_image_kernel.create_kernel(image_program, "image_box_func");
+
+            auto image_in(std::make_unique<float[]>(TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT));
+            auto image_out(std::make_unique<float[]>(TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT));
+            fill_random_data<float>(image_in.get(), TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT, 1.0f, 0.0f);
+            cl_mem image_in_mem = bp_memory.create_image_2d(context, CL_MEM_READ_ONLY,
+                runtime::memory::IMAGE_FORMAT_R_FLOAT, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, image_in.get());
+            cl_sampler sampler = bp_memory.create_sampler(context, false, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST);
+            cl_mem image_out_mem = bp_memory.create_buffer(context, CL_MEM_WRITE_ONLY,
+                sizeof(float) * TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT, nullptr);
+            cl_int image_width = TEST_IMAGE_WIDTH;
+            runtime::set_args(image_kernel, 0, std::pair<cl_mem*, size_t>(&image_in_mem, sizeof(cl_mem)),
+                std::pair<cl_sampler*, size_t>(&sampler, sizeof(cl_sampler)),
+                std::pair<cl_mem*, size_t>(&image_out_mem, sizeof(cl_mem)),
+                std::pair<cl_int*, size_t>(&image_width, sizeof(cl_int)));
+
+            runtime::bp_ndrange image_range{ 2, { 0, 0, 0 }, { TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, 1 },
+                { TEST_LOCAL_SIZE_2D, TEST_LOCAL_SIZE_2D, 1 } };
+            bp_cmdqueue.enqueue_kernel(command_queue, image_kernel, image_range);
+            bp_memory.read_buffer(command_queue, image_out_mem, sizeof(float) * TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT,
+                image_out.get(), runtime::memory::bp_transfer_method::copy);
+
+            // Host box filter with the same clamp to edge addressing.
+            for (size_t y = 0; y < TEST_IMAGE_HEIGHT; ++y) {
+                for (size_t x = 0; x < TEST_IMAGE_WIDTH; ++x) {
+                    float sum = 0.0f;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            long long sample_x = std::min<long long>(
+                                std::max<long long>(static_cast<long long>(x) + dx, 0), TEST_IMAGE_WIDTH - 1);
+                            long long sample_y = std::min<long long>(
+                                std::max<long long>(static_cast<long long>(y) + dy, 0), TEST_IMAGE_HEIGHT - 1);
+                            sum += image_in[sample_y * TEST_IMAGE_WIDTH + sample_x];
+                        }
+                    }
+                    bp_validate_condition(std::abs(image_out[y * TEST_IMAGE_WIDTH + x] - sum / 9.0f) <= 1e-5f,
+                        "Image stencil result is wrong.");
+                }
+            }
+            bp_print_info(true, "Image stencil matches the host box filter.");
         }
-    }
+
+        // Coalesce many small float requests into a few launches.
+        runtime::batch::benchmark_launch_overhead(context, device, command_queue);
+        {
+            runtime::batch::bp_batcher bp_batcher{ context, command_queue, float_batch_kernel,
+                sizeof(float) * 3, sizeof(float), TEST_BATCH_MAX_ITEMS, std::chrono::microseconds(TEST_BATCH_WINDOW_US) };
+            size_t batch_items = std::min(num_elements, TEST_GLOBAL_SIZE_X);
+            auto batch_out(std::make_unique<float[]>(batch_items * TEST_BATCH_REQUESTS));
+            for (size_t k = 0; k < TEST_BATCH_REQUESTS; ++k) {
+                bp_batcher.submit(float_in.get(), batch_out.get() + k * batch_items, batch_items);
+            }
+            bp_batcher.flush();
+            for (size_t k = 0; k < TEST_BATCH_REQUESTS; ++k) {
+                for (size_t n = 0; n < batch_items; ++n) {
+                    float expected = float_in[n * 3] * float_in[n * 3 + 1] + float_in[n * 3 + 2];
+                    float result = batch_out[k * batch_items + n];
+                    bp_validate_condition(std::abs(result - expected) <= 1e-3f * std::max(1.0f, std::abs(expected)),
+                        "Batched request result is wrong.");
+                }
+            }
+            bp_print_info(true, "Batcher ran ", bp_batcher.get_request_count(), " requests in ",
+                bp_batcher.get_launch_count(), " launches.");
+
+            // A lone request is run by the timer once its window expires, without another call.
+            size_t launch_count = bp_batcher.get_launch_count();
+            bp_batcher.submit(float_in.get(), batch_out.get(), batch_items);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            while (bp_batcher.get_launch_count() == launch_count && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::microseconds(TEST_BATCH_WINDOW_US));
+            }
+            bp_validate_condition(bp_batcher.get_launch_count() == launch_count + 1,
+                "Expired batch window didn't run the pending request.");
+        }
+
+        // Run more float jobs than the residency budget holds, buffers are evicted and re-uploaded as needed.
+        {
+            size_t in_size = sizeof(float) * 3 * TEST_RESIDENCY_ITEMS;
+            size_t out_size = sizeof(float) * TEST_RESIDENCY_ITEMS;
+            runtime::residency::bp_residency_manager bp_residency{ context, device, command_queue,
+                (in_size + out_size) * TEST_RESIDENCY_BUDGET_JOBS };
+            std::vector<float> job_in(3 * TEST_RESIDENCY_ITEMS);
+            fill_random_data<float>(job_in.data(), job_in.size(), 127.0f, -128.0f);
+            std::vector<runtime::residency::bp_resident_id> in_ids{};
+            std::vector<runtime::residency::bp_resident_id> out_ids{};
+            for (size_t k = 0; k < TEST_RESIDENCY_JOBS; ++k) {
+                in_ids.push_back(bp_residency.create_buffer(CL_MEM_READ_ONLY, in_size, job_in.data()));
+                out_ids.push_back(bp_residency.create_buffer(CL_MEM_READ_WRITE, out_size, nullptr));
+            }
+
+            // Two passes, so every job has been evicted before it runs again. The second pass reads the outputs of
+            // the first, which have to be written back on eviction and uploaded again.
+            cl_ulong count_arg = TEST_RESIDENCY_ITEMS;
+            runtime::bp_ndrange range{ 1, { 0, 0, 0 }, { TEST_RESIDENCY_ITEMS, 1, 1 }, { 0, 0, 0 } };
+            for (size_t k = 0; k < TEST_RESIDENCY_JOBS; ++k) {
+                runtime::set_arg(float_kernel, 2, sizeof(cl_ulong), &count_arg);
+                bp_residency.enqueue_kernel(float_kernel, range, {
+                    { 0, in_ids[k], runtime::residency::bp_access::read_only },
+                    { 1, out_ids[k], runtime::residency::bp_access::write_only, sizeof(float) } });
+            }
+            for (size_t k = 0; k < TEST_RESIDENCY_JOBS; ++k) {
+                runtime::set_arg(float_chain_kernel, 2, sizeof(cl_ulong), &count_arg);
+                bp_residency.enqueue_kernel(float_chain_kernel, range, {
+                    { 0, in_ids[k], runtime::residency::bp_access::read_only },
+                    { 1, out_ids[k], runtime::residency::bp_access::read_write } });
+            }
+
+            std::vector<float> job_out(TEST_RESIDENCY_ITEMS);
+            for (size_t k = 0; k < TEST_RESIDENCY_JOBS; ++k) {
+                bp_residency.read(out_ids[k], job_out.data());
+                for (size_t n = 0; n < TEST_RESIDENCY_ITEMS; ++n) {
+                    float first = job_in[n * 3] * job_in[n * 3 + 1] + job_in[n * 3 + 2];
+                    float expected = first * job_in[n * 3] + job_in[n * 3 + 2];
+                    bp_validate_condition(
+                        std::abs(job_out[n] - expected) <= 1e-3f * std::max(1.0f, std::abs(expected)),
+                        "Resident job result is wrong.");
+                }
+            }
+            bp_residency.print_stats();
+        }
+
+        // Compare the device radix sort with host sorts.
+        runtime::sort::benchmark_radix_sort(context, device, command_queue, TEST_SORT_SIZE);
+
+        // Tune the tiled GEMM and compare it with the device peak.
+        runtime::gemm::benchmark_gemm(context, device, command_queue, TEST_GEMM_SIZE);
+
+        // Measure device peaks for the roofline report.
+        bp_roofline.measure_device_peak(context, device, command_queue);
+        bp_roofline.print_report();
+    };
+    auto begin = std::chrono::steady_clock::now();
+    bp_executor.run_on_all(run_device);
+    bp_print_info(true, "All ", bp_executor.get_worker_number(), " devices finished in ",
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count(), " ms");
+
+    measure_scaling(bp_executor, bp_transfer_policy);
+
+    runtime::capture::stop_capture();
     return 0;
 }
 
@@ -1,6 +1,7 @@
 #include "bp_opencl_platform.h"
 
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <gsl/pointers>
@@ -19,24 +20,24 @@ static inline void print_platform_info(gsl::not_null<cl_platform_id> platform, c
 }
 
 static inline void print_device_info(gsl::not_null<cl_device_id> device, cl_device_info info)
+{
+    bp_print_info(false, platform::get_device_info_string(device, info));
+}
+
+namespace platform {
+std::string get_device_info_string(gsl::not_null<cl_device_id> device, cl_device_info info)
 {
     auto info_string(std::make_unique<char[]>(MAX_STRING_LENGTH));
     cl_int err = clGetDeviceInfo(device, info, MAX_STRING_LENGTH, info_string.get(), nullptr);
     bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
-    std::string device_info{ info_string.get() };
-    bp_print_info(false, device_info);
+    return std::string{ info_string.get() };
 }
 
-template<typename T>
-static inline T get_device_info_single_type(gsl::not_null<cl_device_id> device, cl_device_info info)
+std::string get_device_key(gsl::not_null<cl_device_id> device)
 {
-    T info_type{};
-    cl_int err = clGetDeviceInfo(device, info, sizeof(T), &info_type, nullptr);
-    bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
-    return info_type;
+    return get_device_info_string(device, CL_DEVICE_NAME) + " / " + get_device_info_string(device, CL_DRIVER_VERSION);
 }
 
-namespace platform {
 bp_platform::bp_platform()
 {
     cl_uint num_platform;
@@ -55,6 +56,8 @@ bp_platform::bp_platform()
 
 void bp_platform::print_info(gsl::not_null<cl_platform_id> platform) const
 {
+    // Workers print at the same time, the lock keeps the lines of one platform together.
+    std::lock_guard<std::recursive_mutex> lock{ get_print_mutex() };
     std::cout << "Info: The name of platform is: ";
     print_platform_info(platform, CL_PLATFORM_NAME);
     std::cout << "Info: The vendor of platform is: ";
@@ -83,6 +86,8 @@ bp_device::bp_device(gsl::not_null<cl_platform_id> platform)
 
 void bp_device::print_info(gsl::not_null<cl_device_id> device) const
 {
+    // Workers print at the same time, the lock keeps the lines of one device together.
+    std::lock_guard<std::recursive_mutex> lock{ get_print_mutex() };
     std::cout << "Info: The name of device is: ";
     print_device_info(device, CL_DEVICE_NAME);
     std::cout << "Info: The vendor of device is: ";
@@ -140,14 +145,16 @@ void bp_device::print_info(gsl::not_null<cl_device_id> device) const
     }
 
     auto double_fp_config = get_device_info_single_type<cl_device_fp_config>(device, CL_DEVICE_DOUBLE_FP_CONFIG);
-    if ((double_fp_config & CL_FP_DENORM) == 0) {
+    if (double_fp_config == 0) {
+        bp_print_info(true, "Device doesn't support double.");
+    } else if ((double_fp_config & CL_FP_DENORM) == 0) {
         bp_print_info(true, "Device doesn't support denormal number of double.");
     } else {
         bp_print_info(true, "Device supports denormal number of double.");
     }
 }
 
-bp_context::bp_context(gsl::not_null<cl_platform_id> platform, bp_device& bp_device)
+bp_context::bp_context(gsl::not_null<cl_platform_id> platform, const bp_device& bp_device)
 {
     const cl_context_properties prop[] = {
         CL_CONTEXT_PLATFORM,
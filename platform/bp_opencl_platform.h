@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <gsl/pointers>
 
 #include "CL/opencl.h"
@@ -9,6 +10,22 @@
 #include "../utils/bp_opencl_common.h"
 
 namespace platform {
+template<typename T>
+inline T get_device_info_single_type(gsl::not_null<cl_device_id> device, cl_device_info info)
+{
+    T info_type{};
+    cl_int err = clGetDeviceInfo(device, info, sizeof(T), &info_type, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
+    return info_type;
+}
+
+std::string get_device_info_string(gsl::not_null<cl_device_id>, cl_device_info);
+
+// Device name and driver version, identifying a device in result caches across runs.
+std::string get_device_key(gsl::not_null<cl_device_id>);
+
+// bp_platform, bp_device and bp_context don't change after construction, so their handles can be read from
+// any thread while the owner outlives the threads using them.
 class bp_platform {
 public:
     bp_platform();
@@ -40,7 +57,7 @@ public:
     {
         for (auto device : m_devices) {
             cl_int err = clReleaseDevice(device);
-            bp_validate_condition(err == CL_SUCCESS, "Release devices failed.");
+            bp_validate_release(err == CL_SUCCESS, "Release devices failed.");
         }
     }
     bp_device(const bp_device&) = delete;
@@ -66,11 +83,11 @@ private:
 
 class bp_context {
 public:
-    bp_context(gsl::not_null<cl_platform_id>, bp_device&);
+    bp_context(gsl::not_null<cl_platform_id>, const bp_device&);
     ~bp_context()
     {
         cl_int err = clReleaseContext(m_context);
-        bp_validate_condition(err == CL_SUCCESS, "Release context failed.");
+        bp_validate_release(err == CL_SUCCESS, "Release context failed.");
     }
     bp_context(const bp_context&) = delete;
     bp_context& operator=(const bp_context&) = delete;
@@ -1,6 +1,7 @@
 #include "bp_opencl_runtime.h"
 
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <gsl/pointers>
@@ -9,8 +10,9 @@
 
 #include "../utils/bp_opencl_common.h"
 #include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime_capture.h"
 
-static void print_event_profiling_info(gsl::not_null<cl_event> event)
+static cl_ulong print_event_profiling_info(gsl::not_null<cl_event> event)
 {
     cl_ulong queued_time, submit_time, start_time, end_time;
     cl_int err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued_time, nullptr);
@@ -25,6 +27,8 @@ static void print_event_profiling_info(gsl::not_null<cl_event> event)
     bp_print_info(true, "Time between queued and submit: ", submit_time - queued_time);
     bp_print_info(true, "Time between submit and start: ", start_time - submit_time);
     bp_print_info(true, "Time between start and end: ", end_time - start_time);
+
+    return end_time - start_time;
 }
 
 namespace runtime {
@@ -34,29 +38,110 @@ cl_command_queue bp_cmdqueue::create_command_queue(gsl::not_null<cl_context> con
     cl_command_queue command_queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
     bp_validate_condition(err == CL_SUCCESS, "Create command queue failed.");
     bp_print_info(true, "Successfully create command queue.");
+    std::lock_guard<std::mutex> lock{ m_mutex };
     m_command_queues.push_back(command_queue);
     return command_queue;
 }
 
-void bp_cmdqueue::enqueue_kernel(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_kernel> kernel) const
+cl_ulong bp_cmdqueue::enqueue_kernel(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_kernel> kernel,
+    size_t global_work_size_x) const
+{
+    bp_ndrange range{ 1, { 0, 0, 0 }, { global_work_size_x, 1, 1 }, { 0, 0, 0 } };
+    return enqueue_kernel(command_queue, kernel, range);
+}
+
+cl_ulong bp_cmdqueue::enqueue_kernel(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_kernel> kernel,
+    const bp_ndrange& range) const
+{
+    cl_device_id device;
+    cl_int err = clGetCommandQueueInfo(command_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get command queue info failed.");
+    auto max_work_item_dimensions = platform::get_device_info_single_type<cl_uint>(device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS);
+    bp_validate_condition(range.work_dim >= 1 && range.work_dim <= 3 && range.work_dim <= max_work_item_dimensions,
+        "Work dimension out of range.");
+
+    bool use_local_size = range.local_size[0] != 0;
+    if (use_local_size) {
+        std::vector<size_t> max_work_item_sizes(max_work_item_dimensions);
+        err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(size_t) * max_work_item_sizes.size(),
+            max_work_item_sizes.data(), nullptr);
+        bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
+        size_t work_group_size = 1;
+        for (auto i = 0; i < range.work_dim; ++i) {
+            bp_validate_condition(range.local_size[i] != 0 && range.local_size[i] <= max_work_item_sizes[i],
+                "Local size out of range.");
+            work_group_size *= range.local_size[i];
+        }
+        bp_validate_condition(work_group_size <= platform::get_device_info_single_type<size_t>(device,
+            CL_DEVICE_MAX_WORK_GROUP_SIZE), "Work group size out of range.");
+    }
+
+    // Split each dimension into a part divisible by the local size and a remainder, then launch every
+    // combination of parts: one launch when sizes divide evenly, up to 2^work_dim otherwise.
+    cl_ulong elapsed_time = 0;
+    for (cl_uint part = 0; part < (1u << range.work_dim); ++part) {
+        size_t offset[3];
+        size_t global_size[3];
+        size_t local_size[3];
+        bool empty = false;
+        for (auto i = 0; i < range.work_dim; ++i) {
+            size_t local = use_local_size ? range.local_size[i] : range.global_size[i];
+            size_t bulk = local == 0 ? 0 : range.global_size[i] / local * local;
+            bool is_remainder = (part >> i) & 1;
+            offset[i] = range.global_offset[i] + (is_remainder ? bulk : 0);
+            global_size[i] = is_remainder ? range.global_size[i] - bulk : bulk;
+            local_size[i] = is_remainder ? global_size[i] : local;
+            empty = empty || global_size[i] == 0;
+        }
+        if (empty) {
+            continue;
+        }
+        elapsed_time += enqueue_range(command_queue, kernel, range.work_dim, offset, global_size,
+            use_local_size ? local_size : nullptr);
+    }
+    capture::record_launch(kernel, range, elapsed_time);
+
+    return elapsed_time;
+}
+
+cl_ulong bp_cmdqueue::enqueue_range(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_kernel> kernel,
+    cl_uint work_dim, const size_t* global_offset, const size_t* global_size, const size_t* local_size) const
 {
-    size_t global_work_size_x = TEST_GLOBAL_SIZE_X;
     cl_event event = nullptr;
-    cl_int err = clEnqueueNDRangeKernel(command_queue, kernel, 1, nullptr, &global_work_size_x, nullptr, 0, nullptr, &event);
+    cl_int err = clEnqueueNDRangeKernel(command_queue, kernel, work_dim, global_offset, global_size, local_size,
+        0, nullptr, &event);
     bp_validate_condition(err == CL_SUCCESS, "Enqueue kernel failed.");
     bp_print_info(true, "Successfully enqueue kernel.");
 
     err = clWaitForEvents(1, &event);
     bp_validate_condition(err == CL_SUCCESS, "Wait for event failed.");
 
-    print_event_profiling_info(event);
+    cl_ulong elapsed_time = print_event_profiling_info(event);
 
     err = clReleaseEvent(event);
     bp_validate_condition(err == CL_SUCCESS, "Release event failed.");
+
+    return elapsed_time;
+}
+
+cl_program bp_program::create_program_with_source(gsl::not_null<cl_context> context,
+    const std::vector<std::string>& kernel_funcs, const platform::bp_device& bp_device)
+{
+    std::vector<cl_device_id> devices{};
+    for (auto i = 0; i < bp_device.get_number(); ++i) {
+        devices.push_back(bp_device.get_ith(i));
+    }
+    return create_program_with_source(context, kernel_funcs, devices);
+}
+
+cl_program bp_program::create_program_with_source(gsl::not_null<cl_context> context,
+    const std::vector<std::string>& kernel_funcs, const std::vector<cl_device_id>& devices)
+{
+    return create_program_with_source(context, kernel_funcs, devices, "");
 }
 
 cl_program bp_program::create_program_with_source(gsl::not_null<cl_context> context,
-    const std::vector<std::string>& kernel_funcs, platform::bp_device& bp_device)
+    const std::vector<std::string>& kernel_funcs, const std::vector<cl_device_id>& devices, const std::string& options)
 {
     cl_uint count = kernel_funcs.size();
     auto strings(std::make_unique<const char*[]>(count));
@@ -72,14 +157,13 @@ cl_program bp_program::create_program_with_source(gsl::not_null<cl_context> cont
     bp_validate_condition(err == CL_SUCCESS, "Create program failed.");
     bp_print_info(true, "Successfully create program.");
 
-    cl_uint num_devices = bp_device.get_number();
-    auto devices(std::make_unique<cl_device_id[]>(num_devices));
-    for (auto i = 0; i < num_devices; ++i) {
-        devices[i] = bp_device.get_ith(i);
+    if (!options.empty()) {
+        bp_print_info(true, "Build options: ", options);
     }
-    err = clBuildProgram(program, num_devices, devices.get(), nullptr, nullptr, nullptr);
+    err = clBuildProgram(program, static_cast<cl_uint>(devices.size()), devices.data(), options.c_str(), nullptr, nullptr);
     bp_validate_condition(err == CL_SUCCESS, "Build program failed.");
     bp_print_info(true, "Successfully build program.");
+    capture::record_program(program, kernel_funcs, options);
 
     m_programs.push_back(program);
 
@@ -92,9 +176,28 @@ cl_kernel bp_kernel::create_kernel(gsl::not_null<cl_program> program, const std:
     cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &err);
     bp_validate_condition(err == CL_SUCCESS, "Create kernel failed.");
     bp_print_info(true, "Successfully create kernel.");
+    capture::record_kernel(kernel, program, kernel_name);
 
     m_kernels.push_back(kernel);
 
     return kernel;
 }
+
+void set_arg(gsl::not_null<cl_kernel> kernel, cl_uint arg_index, size_t arg_size, const void* arg_value,
+    bp_arg_kind kind)
+{
+    cl_int err = clSetKernelArg(kernel, arg_index, arg_size, arg_value);
+    bp_validate_condition(err == CL_SUCCESS, "Set kernel arg failed.");
+    capture::record_arg(kernel, arg_index, arg_size, arg_value, arg_value == nullptr ? bp_arg_kind::local : kind);
+}
+
+void set_arg(gsl::not_null<cl_kernel> kernel, cl_uint arg_index, cl_mem memory)
+{
+    set_arg(kernel, arg_index, sizeof(cl_mem), &memory, bp_arg_kind::memory);
+}
+
+void set_arg(gsl::not_null<cl_kernel> kernel, cl_uint arg_index, cl_sampler sampler)
+{
+    set_arg(kernel, arg_index, sizeof(cl_sampler), &sampler, bp_arg_kind::sampler);
+}
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <type_traits>
 #include <gsl/pointers>
 
 #include "CL/opencl.h"
@@ -11,14 +13,24 @@
 #include "../platform/bp_opencl_platform.h"
 
 namespace runtime {
+// A local size of 0 lets the driver choose. Global sizes needn't be multiples of the local size,
+// the remainder is run as separate launches so kernels need no bounds checks.
+struct bp_ndrange {
+    cl_uint work_dim;
+    size_t global_offset[3];
+    size_t global_size[3];
+    size_t local_size[3];
+};
+
+// Queues may be created from several host threads, the owned handles are guarded by a mutex.
 class bp_cmdqueue {
 public:
-    bp_cmdqueue() : m_command_queues{} {}
+    bp_cmdqueue() : m_mutex{}, m_command_queues{} {}
     ~bp_cmdqueue()
     {
         for (auto command_queue : m_command_queues) {
             cl_int err = clReleaseCommandQueue(command_queue);
-            bp_validate_condition(err == CL_SUCCESS, "Release command queue failed.");
+            bp_validate_release(err == CL_SUCCESS, "Release command queue failed.");
         }
     }
     bp_cmdqueue(const bp_cmdqueue&) = delete;
@@ -28,8 +40,17 @@ public:
 
     cl_command_queue create_command_queue(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>);
 
-    void enqueue_kernel(gsl::not_null<cl_command_queue>, gsl::not_null<cl_kernel>) const;
+    // Runs the kernel over a 1D range, waits for it and returns its start to end time in nanoseconds.
+    cl_ulong enqueue_kernel(gsl::not_null<cl_command_queue>, gsl::not_null<cl_kernel>,
+        size_t global_work_size_x = TEST_GLOBAL_SIZE_X) const;
+
+    // Runs the kernel over a 1D to 3D range and returns the summed start to end time of its launches.
+    cl_ulong enqueue_kernel(gsl::not_null<cl_command_queue>, gsl::not_null<cl_kernel>, const bp_ndrange&) const;
 private:
+    cl_ulong enqueue_range(gsl::not_null<cl_command_queue>, gsl::not_null<cl_kernel>, cl_uint work_dim,
+        const size_t*, const size_t*, const size_t*) const;
+
+    std::mutex m_mutex;
     std::vector<cl_command_queue> m_command_queues;
 };
 
@@ -40,7 +61,7 @@ public:
     {
         for (auto program : m_programs) {
             cl_int err = clReleaseProgram(program);
-            bp_validate_condition(err == CL_SUCCESS, "Release platform failed.");
+            bp_validate_release(err == CL_SUCCESS, "Release platform failed.");
         }
     }
     bp_program(const bp_program&) = delete;
@@ -49,7 +70,11 @@ public:
     bp_program& operator=(bp_program&&) = delete;
 
     cl_program create_program_with_source(gsl::not_null<cl_context>,
-        const std::vector<std::string>&, platform::bp_device&);
+        const std::vector<std::string>&, const platform::bp_device&);
+    cl_program create_program_with_source(gsl::not_null<cl_context>,
+        const std::vector<std::string>&, const std::vector<cl_device_id>&);
+    cl_program create_program_with_source(gsl::not_null<cl_context>,
+        const std::vector<std::string>&, const std::vector<cl_device_id>&, const std::string& options);
 private:
     std::vector<cl_program> m_programs;
 };
@@ -61,7 +86,7 @@ public:
     {
         for (auto kernel : m_kernels) {
             cl_int err = clReleaseKernel(kernel);
-            bp_validate_condition(err == CL_SUCCESS, "Release kernel failed.");
+            bp_validate_release(err == CL_SUCCESS, "Release kernel failed.");
         }
     }
     bp_kernel(const bp_kernel&) = delete;
@@ -74,11 +99,33 @@ private:
     std::vector<cl_kernel> m_kernels;
 };
 
+// What a kernel argument holds, captures record it so replay can map handles to the objects it creates.
+enum class bp_arg_kind : cl_uchar {
+    value,
+    memory,
+    sampler,
+    local
+};
+
+template<typename T>
+constexpr bp_arg_kind get_arg_kind()
+{
+    return std::is_same<T, cl_mem>::value ? bp_arg_kind::memory :
+        std::is_same<T, cl_sampler>::value ? bp_arg_kind::sampler : bp_arg_kind::value;
+}
+
+// Sets one kernel argument, every argument set through the runtime goes here so captures see it.
+// A null value is a __local argument of arg_size bytes.
+void set_arg(gsl::not_null<cl_kernel>, cl_uint arg_index, size_t arg_size, const void* arg_value,
+    bp_arg_kind = bp_arg_kind::value);
+void set_arg(gsl::not_null<cl_kernel>, cl_uint arg_index, cl_mem);
+void set_arg(gsl::not_null<cl_kernel>, cl_uint arg_index, cl_sampler);
+
 template<typename T, typename ... Types>
 inline void set_args(gsl::not_null<cl_kernel> kernel, size_t arg_index, T& arg, Types& ... args)
 {
-    cl_int err = clSetKernelArg(kernel, arg_index, arg.second, arg.first);
-    bp_validate_condition(err == CL_SUCCESS, "Set kernel arg failed.");
+    set_arg(kernel, static_cast<cl_uint>(arg_index), arg.second, arg.first,
+        get_arg_kind<std::remove_cv_t<std::remove_pointer_t<typename T::first_type>>>());
     bp_print_info(true, "Successfully set kernel arg ", arg_index);
     ++arg_index;
     set_args(kernel, arg_index, args ...);
@@ -87,8 +134,8 @@ inline void set_args(gsl::not_null<cl_kernel> kernel, size_t arg_index, T& arg,
 template<typename T>
 inline void set_args(gsl::not_null<cl_kernel> kernel, size_t arg_index, T& arg)
 {
-    cl_int err = clSetKernelArg(kernel, arg_index, arg.second, arg.first);
-    bp_validate_condition(err == CL_SUCCESS, "Set kernel arg failed.");
+    set_arg(kernel, static_cast<cl_uint>(arg_index), arg.second, arg.first,
+        get_arg_kind<std::remove_cv_t<std::remove_pointer_t<typename T::first_type>>>());
     bp_print_info(true, "Successfully set kernel arg ", arg_index);
     bp_print_info(true, "All kernel args have been set.");
 }
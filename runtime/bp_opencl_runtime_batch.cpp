@@ -0,0 +1,217 @@
+#include "bp_opencl_runtime_batch.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr size_t BATCH_GLOBAL_SIZE_MULTIPLE = 64;
+constexpr size_t LAUNCH_BENCHMARK_REPEAT = 100;
+
+static const std::vector<std::string> empty_kernel_funcs{
+    "__kernel void empty_func(__global int* out)\n"
+    "{\n"
+    "}"
+};
+
+static cl_ulong get_event_profiling_time(gsl::not_null<cl_event> event, cl_profiling_info info)
+{
+    cl_ulong time;
+    cl_int err = clGetEventProfilingInfo(event, info, sizeof(cl_ulong), &time, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get event profiling info failed.");
+    return time;
+}
+
+namespace runtime {
+namespace batch {
+bp_batcher::bp_batcher(gsl::not_null<cl_context> context, gsl::not_null<cl_command_queue> command_queue,
+    gsl::not_null<cl_kernel> kernel, size_t in_item_size, size_t out_item_size, size_t max_batch_items,
+    std::chrono::microseconds window) : m_context{ context }, m_command_queue{ command_queue }, m_kernel{ kernel },
+    m_in_item_size{ in_item_size }, m_out_item_size{ out_item_size }, m_max_batch_items{ max_batch_items },
+    m_window{ window }, m_cmdqueue{}, m_requests{}, m_pending_items{ 0 }, m_window_start{}, m_launch_count{ 0 },
+    m_request_count{ 0 }, m_mutex{}, m_condition{}, m_stopping{ false }, m_error{}, m_timer{}
+{
+    m_timer = std::thread{ &bp_batcher::run_timer, this };
+}
+
+bp_batcher::~bp_batcher()
+{
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+    m_timer.join();
+
+    // Destructors can't throw, so a failed last batch on a worker thread is only printed.
+    try {
+        flush();
+    } catch (const bp_error& error) {
+        bp_validate_release(false, error.what());
+    }
+}
+
+void bp_batcher::submit(const void* in, void* out, size_t num_items)
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    bp_validate_condition(m_error.empty(), m_error);
+    if (m_pending_items + num_items > m_max_batch_items) {
+        run_batch();
+    }
+    if (m_requests.empty()) {
+        m_window_start = std::chrono::steady_clock::now();
+        m_condition.notify_one();
+    }
+    m_requests.push_back(bp_batch_request{ in, out, num_items });
+    m_pending_items += num_items;
+    ++m_request_count;
+
+    if (m_pending_items >= m_max_batch_items || std::chrono::steady_clock::now() - m_window_start >= m_window) {
+        run_batch();
+    }
+}
+
+void bp_batcher::poll()
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    bp_validate_condition(m_error.empty(), m_error);
+    if (!m_requests.empty() && std::chrono::steady_clock::now() - m_window_start >= m_window) {
+        run_batch();
+    }
+}
+
+void bp_batcher::flush()
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    bp_validate_condition(m_error.empty(), m_error);
+    run_batch();
+}
+
+void bp_batcher::run_timer()
+{
+    is_worker_thread() = true;
+    std::unique_lock<std::mutex> lock{ m_mutex };
+    while (!m_stopping) {
+        if (m_requests.empty()) {
+            m_condition.wait(lock);
+        } else if (std::chrono::steady_clock::now() - m_window_start >= m_window) {
+            try {
+                run_batch();
+            } catch (const bp_error& error) {
+                m_error = error.what();
+                return;
+            }
+        } else {
+            m_condition.wait_until(lock, m_window_start + m_window);
+        }
+    }
+}
+
+void bp_batcher::run_batch()
+{
+    if (m_requests.empty()) {
+        return;
+    }
+
+    // Pack all inputs back to back and record where each request starts.
+    std::vector<char> in_data(m_in_item_size * m_pending_items);
+    std::vector<cl_uint> offsets{};
+    size_t offset = 0;
+    for (const auto& request : m_requests) {
+        offsets.push_back(static_cast<cl_uint>(offset));
+        std::memcpy(in_data.data() + offset * m_in_item_size, request.in, request.num_items * m_in_item_size);
+        offset += request.num_items;
+    }
+    offsets.push_back(static_cast<cl_uint>(offset));
+
+    memory::bp_memory bp_memory{};
+    cl_mem in_mem = bp_memory.create_buffer(m_context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+        in_data.size(), in_data.data());
+    cl_mem out_mem = bp_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, m_out_item_size * m_pending_items, nullptr);
+    cl_mem offsets_mem = bp_memory.create_buffer(m_context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+        sizeof(cl_uint) * offsets.size(), offsets.data());
+    cl_uint num_requests = static_cast<cl_uint>(m_requests.size());
+    std::pair<cl_mem*, size_t> in_arg(&in_mem, sizeof(cl_mem));
+    std::pair<cl_mem*, size_t> out_arg(&out_mem, sizeof(cl_mem));
+    std::pair<cl_mem*, size_t> offsets_arg(&offsets_mem, sizeof(cl_mem));
+    std::pair<cl_uint*, size_t> num_requests_arg(&num_requests, sizeof(cl_uint));
+    set_args(m_kernel, 0, in_arg, out_arg, offsets_arg, num_requests_arg);
+
+    size_t global_size = (m_pending_items + BATCH_GLOBAL_SIZE_MULTIPLE - 1) / BATCH_GLOBAL_SIZE_MULTIPLE *
+        BATCH_GLOBAL_SIZE_MULTIPLE;
+    m_cmdqueue.enqueue_kernel(m_command_queue, m_kernel, global_size);
+    ++m_launch_count;
+
+    // Scatter the results back to each caller.
+    std::vector<char> out_data(m_out_item_size * m_pending_items);
+    cl_int err = clEnqueueReadBuffer(m_command_queue, out_mem, CL_TRUE, 0, out_data.size(), out_data.data(),
+        0, nullptr, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Read buffer failed.");
+    for (auto i = 0; i < m_requests.size(); ++i) {
+        std::memcpy(m_requests[i].out, out_data.data() + offsets[i] * m_out_item_size,
+            m_requests[i].num_items * m_out_item_size);
+    }
+    bp_print_info(true, "Batched ", m_requests.size(), " requests of ", m_pending_items, " items into one launch.");
+
+    m_requests.clear();
+    m_pending_items = 0;
+}
+
+void benchmark_launch_overhead(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue)
+{
+    bp_program bp_program{};
+    bp_kernel bp_kernel{};
+    memory::bp_memory bp_memory{};
+    cl_program program = bp_program.create_program_with_source(context, empty_kernel_funcs,
+        std::vector<cl_device_id>{ device });
+    cl_kernel kernel = bp_kernel.create_kernel(program, "empty_func");
+    cl_mem out_mem = bp_memory.create_buffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_int), nullptr);
+    std::pair<cl_mem*, size_t> out_arg(&out_mem, sizeof(cl_mem));
+    set_args(kernel, 0, out_arg);
+
+    // Synchronous launches expose the full round trip a lone small request pays.
+    size_t global_size = 1;
+    cl_ulong queued_to_start = 0;
+    cl_ulong start_to_end = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (auto i = 0; i < LAUNCH_BENCHMARK_REPEAT; ++i) {
+        cl_event event = nullptr;
+        cl_int err = clEnqueueNDRangeKernel(command_queue, kernel, 1, nullptr, &global_size, nullptr, 0, nullptr, &event);
+        bp_validate_condition(err == CL_SUCCESS, "Enqueue kernel failed.");
+        err = clWaitForEvents(1, &event);
+        bp_validate_condition(err == CL_SUCCESS, "Wait for event failed.");
+        cl_ulong start_time = get_event_profiling_time(event, CL_PROFILING_COMMAND_START);
+        queued_to_start += start_time - get_event_profiling_time(event, CL_PROFILING_COMMAND_QUEUED);
+        start_to_end += get_event_profiling_time(event, CL_PROFILING_COMMAND_END) - start_time;
+        err = clReleaseEvent(event);
+        bp_validate_condition(err == CL_SUCCESS, "Release event failed.");
+    }
+    auto sync_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+
+    // Pipelined launches show how much of that the driver hides when requests are back to back.
+    begin = std::chrono::steady_clock::now();
+    for (auto i = 0; i < LAUNCH_BENCHMARK_REPEAT; ++i) {
+        cl_int err = clEnqueueNDRangeKernel(command_queue, kernel, 1, nullptr, &global_size, nullptr, 0, nullptr, nullptr);
+        bp_validate_condition(err == CL_SUCCESS, "Enqueue kernel failed.");
+    }
+    cl_int err = clFinish(command_queue);
+    bp_validate_condition(err == CL_SUCCESS, "Finish command queue failed.");
+    auto pipelined_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+
+    bp_print_info(true, "Launch overhead, synchronous round trip: ", sync_time.count() / LAUNCH_BENCHMARK_REPEAT, " ns");
+    bp_print_info(true, "Launch overhead, queued to start: ", queued_to_start / LAUNCH_BENCHMARK_REPEAT, " ns");
+    bp_print_info(true, "Launch overhead, empty kernel execution: ", start_to_end / LAUNCH_BENCHMARK_REPEAT, " ns");
+    bp_print_info(true, "Launch overhead, pipelined: ", pipelined_time.count() / LAUNCH_BENCHMARK_REPEAT, " ns");
+}
+}
+}
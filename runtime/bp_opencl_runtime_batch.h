@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+
+namespace runtime {
+namespace batch {
+// Coalesces small launches of one kernel into a single NDRange. The batched kernel takes
+// (in, out, offsets, num_requests): request r owns work items [offsets[r], offsets[r + 1]) and
+// offsets[num_requests] is the total, so padded work items must return early.
+// A timer thread runs a partial batch once the window of its first request expires, so no request waits
+// longer than the window plus one launch. The kernel must not be used elsewhere while the batcher exists.
+// A failure on the timer thread stops the timer and is reported by the next submit, poll or flush.
+class bp_batcher {
+public:
+    bp_batcher(gsl::not_null<cl_context>, gsl::not_null<cl_command_queue>, gsl::not_null<cl_kernel>,
+        size_t in_item_size, size_t out_item_size, size_t max_batch_items, std::chrono::microseconds window);
+    ~bp_batcher();
+    bp_batcher(const bp_batcher&) = delete;
+    bp_batcher& operator=(const bp_batcher&) = delete;
+    bp_batcher(bp_batcher&&) = delete;
+    bp_batcher& operator=(bp_batcher&&) = delete;
+
+    // Queues a request whose results are written to out once its batch runs, which may happen on the
+    // timer thread. Results are only safe to read after flush() returns.
+    void submit(const void* in, void* out, size_t num_items);
+
+    // Runs the pending batch if its window has expired.
+    void poll();
+
+    // Runs the pending batch and waits for every earlier one.
+    void flush();
+
+    size_t get_launch_count() const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return m_launch_count;
+    }
+
+    size_t get_request_count() const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return m_request_count;
+    }
+private:
+    struct bp_batch_request {
+        const void* in;
+        void* out;
+        size_t num_items;
+    };
+
+    // Called with m_mutex held.
+    void run_batch();
+    void run_timer();
+
+    cl_context m_context;
+    cl_command_queue m_command_queue;
+    cl_kernel m_kernel;
+    size_t m_in_item_size;
+    size_t m_out_item_size;
+    size_t m_max_batch_items;
+    std::chrono::microseconds m_window;
+    bp_cmdqueue m_cmdqueue;
+    std::vector<bp_batch_request> m_requests;
+    size_t m_pending_items;
+    std::chrono::steady_clock::time_point m_window_start;
+    size_t m_launch_count;
+    size_t m_request_count;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping;
+    std::string m_error;
+    std::thread m_timer;
+};
+
+// Times back to back launches of an empty kernel and prints the per launch overhead of the device.
+void benchmark_launch_overhead(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>);
+}
+}
@@ -0,0 +1,653 @@
+#include "bp_opencl_runtime_capture.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr char CAPTURE_MAGIC[4] = { 'B', 'P', 'C', 'P' };
+constexpr cl_uint CAPTURE_VERSION = 3;
+
+// Device tag of records made outside the executor workers.
+constexpr cl_uint CAPTURE_HOST_DEVICE = 0xFFFFFFFF;
+
+// Bytes kept per object in sampled captures.
+constexpr size_t CAPTURE_SAMPLE_SIZE = 4096;
+
+enum class bp_record_type : cl_uchar {
+    program,
+    kernel,
+    buffer,
+    image,
+    sampler,
+    write_buffer,
+    read_buffer,
+    write_image,
+    arg,
+    launch,
+    release_memory,
+    release_sampler
+};
+
+// Capture state is shared by every thread recording through the runtime wrappers.
+static std::mutex capture_mutex;
+static std::ofstream capture_file;
+static runtime::capture::bp_capture_contents capture_contents = runtime::capture::bp_capture_contents::full;
+
+// Platform and device index of the worker recording on this thread.
+struct bp_capture_device {
+    cl_uint platform_index;
+    cl_uint device_index;
+};
+
+static bp_capture_device& get_capture_device()
+{
+    thread_local bp_capture_device capture_device{ CAPTURE_HOST_DEVICE, CAPTURE_HOST_DEVICE };
+    return capture_device;
+}
+
+// Handles identify objects within a capture, replay maps them to the objects it creates.
+static cl_ulong get_handle_id(const void* handle)
+{
+    return static_cast<cl_ulong>(reinterpret_cast<std::uintptr_t>(handle));
+}
+
+template<typename T>
+static void write_value(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void write_bytes(std::ostream& stream, const void* data, size_t size)
+{
+    write_value<cl_ulong>(stream, size);
+    stream.write(static_cast<const char*>(data), size);
+}
+
+static void write_string(std::ostream& stream, const std::string& string)
+{
+    write_bytes(stream, string.data(), string.size());
+}
+
+static void write_record_type(std::ostream& stream, bp_record_type type)
+{
+    write_value(stream, static_cast<cl_uchar>(type));
+}
+
+// Records of different workers interleave in the file, so each one carries the device it was made on and
+// its payload size, which lets replay skip the records of other devices.
+static void write_record(bp_record_type type, const std::ostringstream& record)
+{
+    const auto& capture_device = get_capture_device();
+    write_record_type(capture_file, type);
+    write_value(capture_file, capture_device.platform_index);
+    write_value(capture_file, capture_device.device_index);
+    write_string(capture_file, record.str());
+}
+
+// FNV-1a over the contents.
+static cl_ulong hash_contents(const void* data, size_t size)
+{
+    cl_ulong hash = 14695981039346656037ull;
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void write_contents(std::ostream& stream, const void* data, size_t size)
+{
+    write_value<cl_ulong>(stream, size);
+    switch (capture_contents) {
+        case runtime::capture::bp_capture_contents::full:
+            write_bytes(stream, data, size);
+            break;
+        case runtime::capture::bp_capture_contents::sampled:
+            write_bytes(stream, data, std::min(size, CAPTURE_SAMPLE_SIZE));
+            break;
+        case runtime::capture::bp_capture_contents::hashed:
+        default:
+            write_value<cl_ulong>(stream, hash_contents(data, size));
+            break;
+    }
+}
+
+static size_t get_image_size(cl_mem image, const size_t* region)
+{
+    size_t element_size;
+    cl_int err = clGetImageInfo(image, CL_IMAGE_ELEMENT_SIZE, sizeof(size_t), &element_size, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get image info failed.");
+    return element_size * region[0] * region[1] * region[2];
+}
+
+template<typename T>
+static T read_value(std::istream& stream)
+{
+    T value{};
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    bp_validate_condition(stream.good(), "Capture file is truncated.");
+    return value;
+}
+
+static std::vector<char> read_raw(std::istream& stream, size_t size)
+{
+    std::vector<char> data(size);
+    stream.read(data.data(), size);
+    bp_validate_condition(stream.good(), "Capture file is truncated.");
+    return data;
+}
+
+static std::vector<char> read_bytes(std::istream& stream)
+{
+    return read_raw(stream, read_value<cl_ulong>(stream));
+}
+
+static std::string read_string(std::istream& stream)
+{
+    auto bytes = read_bytes(stream);
+    return std::string{ bytes.begin(), bytes.end() };
+}
+
+// Rebuilds contents by repeating the recorded sample, or from data seeded by the recorded hash.
+static std::vector<char> read_contents(std::istream& stream, runtime::capture::bp_capture_contents contents)
+{
+    std::vector<char> data(read_value<cl_ulong>(stream));
+    if (contents == runtime::capture::bp_capture_contents::hashed) {
+        std::mt19937_64 generator{ read_value<cl_ulong>(stream) };
+        for (size_t i = 0; i < data.size(); i += sizeof(cl_ulong)) {
+            cl_ulong random = generator();
+            std::memcpy(data.data() + i, &random, std::min(sizeof(cl_ulong), data.size() - i));
+        }
+        return data;
+    }
+
+    auto sample = read_bytes(stream);
+    if (!sample.empty()) {
+        for (size_t i = 0; i < data.size(); i += sample.size()) {
+            std::copy_n(sample.begin(), std::min(sample.size(), data.size() - i), data.begin() + i);
+        }
+    }
+    return data;
+}
+
+template<typename T>
+static T find_handle(const std::map<cl_ulong, T>& handles, cl_ulong id)
+{
+    auto iter = handles.find(id);
+    bp_validate_condition(iter != handles.end(), "Capture refers to an unknown object.");
+    return iter->second;
+}
+
+namespace runtime {
+namespace capture {
+bp_capture_contents get_capture_contents(const std::string& name)
+{
+    if (name == "full") {
+        return bp_capture_contents::full;
+    }
+    if (name == "sampled") {
+        return bp_capture_contents::sampled;
+    }
+    bp_validate_condition(name == "hashed", "Capture contents must be full, sampled or hashed.");
+    return bp_capture_contents::hashed;
+}
+
+void set_capture_device(size_t platform_index, size_t device_index)
+{
+    get_capture_device() = bp_capture_device{ static_cast<cl_uint>(platform_index),
+        static_cast<cl_uint>(device_index) };
+}
+
+void start_capture(const std::string& path, bp_capture_contents contents)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    bp_validate_condition(!capture_file.is_open(), "A capture is already active.");
+    capture_file.open(path, std::ios::binary | std::ios::trunc);
+    bp_validate_condition(capture_file.is_open(), "Open capture file failed.");
+    capture_contents = contents;
+
+    capture_file.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    write_value(capture_file, CAPTURE_VERSION);
+    write_value(capture_file, static_cast<cl_uchar>(contents));
+    bp_print_info(true, "Capture workload to ", path);
+}
+
+void stop_capture()
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (capture_file.is_open()) {
+        capture_file.close();
+        bp_validate_condition(!capture_file.fail(), "Write capture file failed.");
+    }
+}
+
+bool is_capturing()
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    return capture_file.is_open();
+}
+
+void record_program(cl_program program, const std::vector<std::string>& kernel_funcs, const std::string& options)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(program));
+    write_value(record, static_cast<cl_uint>(kernel_funcs.size()));
+    for (const auto& kernel_func : kernel_funcs) {
+        write_string(record, kernel_func);
+    }
+    write_string(record, options);
+    write_record(bp_record_type::program, record);
+}
+
+void record_kernel(cl_kernel kernel, cl_program program, const std::string& kernel_name)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(kernel));
+    write_value(record, get_handle_id(program));
+    write_string(record, kernel_name);
+    write_record(bp_record_type::kernel, record);
+}
+
+void record_buffer(cl_mem buffer, cl_mem_flags flags, size_t size, const void* host_ptr)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    bool has_contents = host_ptr != nullptr && (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0;
+    std::ostringstream record{};
+    write_value(record, get_handle_id(buffer));
+    write_value<cl_ulong>(record, flags);
+    write_value<cl_ulong>(record, size);
+    write_value<cl_uchar>(record, has_contents ? 1 : 0);
+    if (has_contents) {
+        write_contents(record, host_ptr, size);
+    }
+    write_record(bp_record_type::buffer, record);
+}
+
+void record_image(cl_mem image, cl_mem_flags flags, const cl_image_format& format, const cl_image_desc& desc,
+    const void* host_ptr)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(image));
+    write_value<cl_ulong>(record, flags);
+    write_value<cl_uint>(record, format.image_channel_order);
+    write_value<cl_uint>(record, format.image_channel_data_type);
+    write_value<cl_uint>(record, desc.image_type);
+    write_value<cl_ulong>(record, desc.image_width);
+    write_value<cl_ulong>(record, desc.image_height);
+    write_value<cl_ulong>(record, desc.image_depth);
+    write_value<cl_uchar>(record, host_ptr != nullptr ? 1 : 0);
+    if (host_ptr != nullptr) {
+        const size_t region[3] = { desc.image_width, desc.image_height, std::max<size_t>(desc.image_depth, 1) };
+        write_contents(record, host_ptr, get_image_size(image, region));
+    }
+    write_record(bp_record_type::image, record);
+}
+
+void record_sampler(cl_sampler sampler, bool normalized_coords, cl_addressing_mode addressing_mode,
+    cl_filter_mode filter_mode)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(sampler));
+    write_value<cl_uchar>(record, normalized_coords ? 1 : 0);
+    write_value<cl_uint>(record, addressing_mode);
+    write_value<cl_uint>(record, filter_mode);
+    write_record(bp_record_type::sampler, record);
+}
+
+void record_write_buffer(cl_mem buffer, size_t size, const void* host_ptr)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(buffer));
+    write_contents(record, host_ptr, size);
+    write_record(bp_record_type::write_buffer, record);
+}
+
+void record_read_buffer(cl_mem buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(buffer));
+    write_value<cl_ulong>(record, size);
+    write_record(bp_record_type::read_buffer, record);
+}
+
+void record_write_image(cl_mem image, const size_t* region, const void* host_ptr)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(image));
+    for (auto i = 0; i < 3; ++i) {
+        write_value<cl_ulong>(record, region[i]);
+    }
+    write_contents(record, host_ptr, get_image_size(image, region));
+    write_record(bp_record_type::write_image, record);
+}
+
+// The kind comes from the call site, memory objects and samplers are stored as handles.
+void record_arg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void* arg_value, bp_arg_kind kind)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(kernel));
+    write_value(record, arg_index);
+    write_value<cl_ulong>(record, arg_size);
+    write_value(record, static_cast<cl_uchar>(kind));
+    if (kind == bp_arg_kind::value) {
+        record.write(static_cast<const char*>(arg_value), arg_size);
+    } else if (kind != bp_arg_kind::local) {
+        write_value(record, get_handle_id(*static_cast<void* const*>(arg_value)));
+    }
+    write_record(bp_record_type::arg, record);
+}
+
+void record_release(cl_mem memory)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(memory));
+    write_record(bp_record_type::release_memory, record);
+}
+
+void record_release(cl_sampler sampler)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(sampler));
+    write_record(bp_record_type::release_sampler, record);
+}
+
+void record_launch(cl_kernel kernel, const bp_ndrange& range, cl_ulong elapsed_time)
+{
+    std::lock_guard<std::mutex> lock{ capture_mutex };
+    if (!capture_file.is_open()) {
+        return;
+    }
+    std::ostringstream record{};
+    write_value(record, get_handle_id(kernel));
+    write_value(record, range.work_dim);
+    for (const auto* sizes : { range.global_offset, range.global_size, range.local_size }) {
+        for (auto i = 0; i < 3; ++i) {
+            write_value<cl_ulong>(record, sizes[i]);
+        }
+    }
+    write_value(record, elapsed_time);
+    write_record(bp_record_type::launch, record);
+}
+
+bp_replay::bp_replay(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device, size_t platform_index,
+    size_t device_index) :
+    m_context{ context }, m_device{ device }, m_platform_index{ static_cast<cl_uint>(platform_index) },
+    m_device_index{ static_cast<cl_uint>(device_index) }, m_program{}, m_kernel{}, m_cmdqueue{}, m_memory{}, m_programs{},
+    m_kernels{}, m_kernel_names{}, m_memories{}, m_samplers{}
+{
+}
+
+cl_ulong bp_replay::run(gsl::not_null<cl_command_queue> command_queue, const std::string& path)
+{
+    std::ifstream file{ path, std::ios::binary };
+    bp_validate_condition(file.is_open(), "Open capture file failed.");
+    char magic[sizeof(CAPTURE_MAGIC)];
+    file.read(magic, sizeof(magic));
+    bp_validate_condition(file.good() && std::equal(magic, magic + sizeof(magic), CAPTURE_MAGIC),
+        "Not a capture file.");
+    bp_validate_condition(read_value<cl_uint>(file) == CAPTURE_VERSION, "Capture version isn't supported.");
+    auto contents = static_cast<bp_capture_contents>(read_value<cl_uchar>(file));
+    bp_print_info(true, "Replay ", path, " recorded on platform ", m_platform_index, " device ", m_device_index,
+        " on ", platform::get_device_info_string(m_device, CL_DEVICE_NAME));
+
+    auto max_work_item_dimensions = platform::get_device_info_single_type<cl_uint>(m_device,
+        CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS);
+    std::vector<size_t> max_work_item_sizes(max_work_item_dimensions);
+    cl_int err = clGetDeviceInfo(m_device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(size_t) * max_work_item_sizes.size(),
+        max_work_item_sizes.data(), nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
+
+    size_t num_launches = 0;
+    cl_ulong recorded_total = 0;
+    cl_ulong replayed_total = 0;
+    std::map<std::string, std::pair<cl_ulong, cl_ulong>> kernel_times{};
+    cl_uchar type;
+    while (file.read(reinterpret_cast<char*>(&type), sizeof(type))) {
+        auto platform_index = read_value<cl_uint>(file);
+        auto device_index = read_value<cl_uint>(file);
+        auto record_size = read_value<cl_ulong>(file);
+        bool is_host = platform_index == CAPTURE_HOST_DEVICE && device_index == CAPTURE_HOST_DEVICE;
+        if (!is_host && (platform_index != m_platform_index || device_index != m_device_index)) {
+            file.seekg(static_cast<std::streamoff>(record_size), std::ios::cur);
+            continue;
+        }
+        switch (static_cast<bp_record_type>(type)) {
+            case bp_record_type::program: {
+                auto id = read_value<cl_ulong>(file);
+                auto count = read_value<cl_uint>(file);
+                std::vector<std::string> kernel_funcs{};
+                for (cl_uint i = 0; i < count; ++i) {
+                    kernel_funcs.push_back(read_string(file));
+                }
+                auto options = read_string(file);
+                m_programs[id] = m_program.create_program_with_source(m_context, kernel_funcs,
+                    std::vector<cl_device_id>{ m_device }, options);
+                break;
+            }
+            case bp_record_type::kernel: {
+                auto id = read_value<cl_ulong>(file);
+                cl_program program = find_handle(m_programs, read_value<cl_ulong>(file));
+                auto kernel_name = read_string(file);
+                m_kernels[id] = m_kernel.create_kernel(program, kernel_name);
+                m_kernel_names[id] = kernel_name;
+                break;
+            }
+            case bp_record_type::buffer: {
+                auto id = read_value<cl_ulong>(file);
+                auto flags = read_value<cl_ulong>(file) & (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY);
+                auto size = read_value<cl_ulong>(file);
+                if (read_value<cl_uchar>(file) != 0) {
+                    auto data = read_contents(file, contents);
+                    m_memories[id] = m_memory.create_buffer(m_context, flags | CL_MEM_COPY_HOST_PTR, size, data.data());
+                } else {
+                    m_memories[id] = m_memory.create_buffer(m_context, flags, size, nullptr);
+                }
+                break;
+            }
+            case bp_record_type::image: {
+                auto id = read_value<cl_ulong>(file);
+                auto flags = read_value<cl_ulong>(file) & (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY);
+                cl_image_format format{};
+                format.image_channel_order = read_value<cl_uint>(file);
+                format.image_channel_data_type = read_value<cl_uint>(file);
+                auto image_type = read_value<cl_uint>(file);
+                auto width = read_value<cl_ulong>(file);
+                auto height = read_value<cl_ulong>(file);
+                auto depth = read_value<cl_ulong>(file);
+                std::vector<char> data{};
+                if (read_value<cl_uchar>(file) != 0) {
+                    data = read_contents(file, contents);
+                }
+                void* host_ptr = data.empty() ? nullptr : data.data();
+                m_memories[id] = image_type == CL_MEM_OBJECT_IMAGE3D ?
+                    m_memory.create_image_3d(m_context, flags, format, width, height, depth, host_ptr) :
+                    m_memory.create_image_2d(m_context, flags, format, width, height, host_ptr);
+                break;
+            }
+            case bp_record_type::sampler: {
+                auto id = read_value<cl_ulong>(file);
+                bool normalized_coords = read_value<cl_uchar>(file) != 0;
+                auto addressing_mode = read_value<cl_uint>(file);
+                auto filter_mode = read_value<cl_uint>(file);
+                m_samplers[id] = m_memory.create_sampler(m_context, normalized_coords, addressing_mode, filter_mode);
+                break;
+            }
+            case bp_record_type::write_buffer: {
+                cl_mem buffer = find_handle(m_memories, read_value<cl_ulong>(file));
+                auto data = read_contents(file, contents);
+                m_memory.write_buffer(command_queue, buffer, data.size(), data.data(),
+                    memory::bp_transfer_method::copy);
+                break;
+            }
+            case bp_record_type::read_buffer: {
+                cl_mem buffer = find_handle(m_memories, read_value<cl_ulong>(file));
+                std::vector<char> data(read_value<cl_ulong>(file));
+                m_memory.read_buffer(command_queue, buffer, data.size(), data.data(),
+                    memory::bp_transfer_method::copy);
+                break;
+            }
+            case bp_record_type::write_image: {
+                cl_mem image = find_handle(m_memories, read_value<cl_ulong>(file));
+                size_t region[3];
+                for (auto i = 0; i < 3; ++i) {
+                    region[i] = read_value<cl_ulong>(file);
+                }
+                auto data = read_contents(file, contents);
+                m_memory.write_image(command_queue, image, region, data.data());
+                break;
+            }
+            case bp_record_type::arg: {
+                cl_kernel kernel = find_handle(m_kernels, read_value<cl_ulong>(file));
+                auto arg_index = read_value<cl_uint>(file);
+                auto arg_size = read_value<cl_ulong>(file);
+                switch (static_cast<bp_arg_kind>(read_value<cl_uchar>(file))) {
+                    case bp_arg_kind::value: {
+                        auto value = read_raw(file, arg_size);
+                        set_arg(kernel, arg_index, arg_size, value.data());
+                        break;
+                    }
+                    case bp_arg_kind::memory: {
+                        // A null memory object is a valid argument and is recorded as handle 0.
+                        auto memory_id = read_value<cl_ulong>(file);
+                        cl_mem memory = memory_id == 0 ? nullptr : find_handle(m_memories, memory_id);
+                        set_arg(kernel, arg_index, memory);
+                        break;
+                    }
+                    case bp_arg_kind::sampler: {
+                        cl_sampler sampler = find_handle(m_samplers, read_value<cl_ulong>(file));
+                        set_arg(kernel, arg_index, sampler);
+                        break;
+                    }
+                    case bp_arg_kind::local:
+                    default:
+                        set_arg(kernel, arg_index, arg_size, nullptr);
+                        break;
+                }
+                break;
+            }
+            case bp_record_type::launch: {
+                auto id = read_value<cl_ulong>(file);
+                cl_kernel kernel = find_handle(m_kernels, id);
+                bp_ndrange range{};
+                range.work_dim = read_value<cl_uint>(file);
+                for (auto* sizes : { range.global_offset, range.global_size, range.local_size }) {
+                    for (auto i = 0; i < 3; ++i) {
+                        sizes[i] = read_value<cl_ulong>(file);
+                    }
+                }
+                auto recorded_time = read_value<cl_ulong>(file);
+
+                if (range.local_size[0] != 0) {
+                    size_t max_size;
+                    err = clGetKernelWorkGroupInfo(kernel, m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t),
+                        &max_size, nullptr);
+                    bp_validate_condition(err == CL_SUCCESS, "Get kernel work group info failed.");
+                    size_t work_group_size = 1;
+                    bool fits = range.work_dim <= max_work_item_sizes.size();
+                    for (cl_uint i = 0; fits && i < range.work_dim; ++i) {
+                        work_group_size *= range.local_size[i];
+                        fits = range.local_size[i] <= max_work_item_sizes[i];
+                    }
+                    if (!fits || work_group_size > max_size) {
+                        bp_print_info(true, "Recorded local size doesn't fit the device, let the driver choose.");
+                        std::fill(range.local_size, range.local_size + 3, 0);
+                    }
+                }
+
+                cl_ulong replayed_time = m_cmdqueue.enqueue_kernel(command_queue, kernel, range);
+                const auto& kernel_name = m_kernel_names[id];
+                bp_print_info(true, "Launch ", num_launches, " ", kernel_name, ": recorded ", recorded_time,
+                    " ns, replayed ", replayed_time, " ns");
+                kernel_times[kernel_name].first += recorded_time;
+                kernel_times[kernel_name].second += replayed_time;
+                recorded_total += recorded_time;
+                replayed_total += replayed_time;
+                ++num_launches;
+                break;
+            }
+            case bp_record_type::release_memory: {
+                auto id = read_value<cl_ulong>(file);
+                m_memory.release(find_handle(m_memories, id));
+                m_memories.erase(id);
+                break;
+            }
+            case bp_record_type::release_sampler: {
+                auto id = read_value<cl_ulong>(file);
+                m_memory.release(find_handle(m_samplers, id));
+                m_samplers.erase(id);
+                break;
+            }
+            default:
+                bp_validate_condition(false, "Unknown capture record.");
+        }
+    }
+
+    for (const auto& kernel_time : kernel_times) {
+        bp_print_info(true, "Kernel ", kernel_time.first, ": recorded ", kernel_time.second.first, " ns, replayed ",
+            kernel_time.second.second, " ns");
+    }
+    bp_print_info(true, "Replayed ", num_launches, " launches: recorded ", recorded_total, " ns, replayed ",
+        replayed_total, " ns");
+    return replayed_total;
+}
+}
+}
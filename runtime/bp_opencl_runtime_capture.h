@@ -0,0 +1,80 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+namespace runtime {
+namespace capture {
+// How buffer and image contents are stored: every byte, a leading sample that replay repeats over the
+// object, or only a hash, in which case replay fills the object with data seeded by it.
+enum class bp_capture_contents {
+    full,
+    sampled,
+    hashed
+};
+
+bp_capture_contents get_capture_contents(const std::string& name);
+
+// Records programs, kernels, memory objects and their releases, kernel arguments and launches made through
+// the runtime wrappers to a binary file, in the order they happen. One capture is active per process, each
+// record is tagged with the device of the thread that made it.
+void start_capture(const std::string& path, bp_capture_contents);
+void stop_capture();
+bool is_capturing();
+
+// Tags the records made on the calling thread, executor workers set their platform and device index.
+void set_capture_device(size_t platform_index, size_t device_index);
+
+void record_program(cl_program, const std::vector<std::string>& kernel_funcs, const std::string& options);
+void record_kernel(cl_kernel, cl_program, const std::string& kernel_name);
+void record_buffer(cl_mem, cl_mem_flags, size_t, const void* host_ptr);
+void record_image(cl_mem, cl_mem_flags, const cl_image_format&, const cl_image_desc&, const void* host_ptr);
+void record_sampler(cl_sampler, bool normalized_coords, cl_addressing_mode, cl_filter_mode);
+void record_write_buffer(cl_mem, size_t, const void*);
+void record_read_buffer(cl_mem, size_t);
+void record_write_image(cl_mem, const size_t* region, const void*);
+void record_arg(cl_kernel, cl_uint arg_index, size_t arg_size, const void* arg_value, bp_arg_kind);
+void record_release(cl_mem);
+void record_release(cl_sampler);
+void record_launch(cl_kernel, const bp_ndrange&, cl_ulong elapsed_time);
+
+// Re-executes the records one device made in a capture, in recorded order, on a device, and compares each
+// launch with its recorded time. Records made outside the workers are replayed on every device.
+// Recorded local sizes the device can't run are left to the driver. Objects are released where the capture
+// released them.
+class bp_replay {
+public:
+    // The platform and device index select the recorded device to replay.
+    bp_replay(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, size_t platform_index, size_t device_index);
+    bp_replay(const bp_replay&) = delete;
+    bp_replay& operator=(const bp_replay&) = delete;
+    bp_replay(bp_replay&&) = delete;
+    bp_replay& operator=(bp_replay&&) = delete;
+
+    // Returns the summed kernel time of the replayed launches in nanoseconds.
+    cl_ulong run(gsl::not_null<cl_command_queue>, const std::string& path);
+private:
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_uint m_platform_index;
+    cl_uint m_device_index;
+    bp_program m_program;
+    bp_kernel m_kernel;
+    bp_cmdqueue m_cmdqueue;
+    memory::bp_memory m_memory;
+    std::map<cl_ulong, cl_program> m_programs;
+    std::map<cl_ulong, cl_kernel> m_kernels;
+    std::map<cl_ulong, std::string> m_kernel_names;
+    std::map<cl_ulong, cl_mem> m_memories;
+    std::map<cl_ulong, cl_sampler> m_samplers;
+};
+}
+}
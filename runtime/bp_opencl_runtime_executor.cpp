@@ -0,0 +1,157 @@
+#include "bp_opencl_runtime_executor.h"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_capture.h"
+
+namespace runtime {
+namespace executor {
+bp_executor::bp_executor(const platform::bp_platform& bp_platform) :
+    m_platforms(bp_platform.get_number()), m_cmdqueue{}, m_workers{}
+{
+    // Platforms are independent, so their devices and contexts are created at the same time.
+    std::vector<std::future<void>> platforms_ready{};
+    for (size_t i = 0; i < m_platforms.size(); ++i) {
+        platforms_ready.push_back(std::async(std::launch::async, [this, &bp_platform, i]() {
+            is_worker_thread() = true;
+            cl_platform_id platform = bp_platform.get_ith(i);
+            m_platforms[i].devices = std::make_unique<platform::bp_device>(platform);
+            m_platforms[i].context = std::make_unique<platform::bp_context>(platform, *m_platforms[i].devices);
+        }));
+    }
+    wait_for_jobs(platforms_ready);
+
+    // The first job of every worker creates the command queue of its device.
+    std::vector<std::future<void>> queues_ready{};
+    for (size_t i = 0; i < m_platforms.size(); ++i) {
+        const auto& bp_device = *m_platforms[i].devices;
+        for (size_t j = 0; j < bp_device.get_number(); ++j) {
+            auto worker(std::make_unique<bp_worker>());
+            worker->device = bp_worker_device{ m_workers.size(), i, j, bp_platform.get_ith(i),
+                m_platforms[i].context->get(), bp_device.get_ith(j), nullptr };
+            worker->stopping = false;
+            worker->thread = std::thread{ &bp_executor::work, this, std::ref(*worker) };
+
+            bp_worker& created = *worker;
+            m_workers.push_back(std::move(worker));
+            queues_ready.push_back(enqueue(created, std::packaged_task<void()>{ [this, &created]() {
+                created.device.command_queue = m_cmdqueue.create_command_queue(created.device.context,
+                    created.device.device);
+            } }));
+        }
+    }
+    wait_for_jobs(queues_ready);
+    bp_print_info(true, "Executor started ", m_workers.size(), " device workers.");
+}
+
+bp_executor::~bp_executor()
+{
+    // Workers finish their queued jobs before they stop, queues and contexts are released after that.
+    for (auto& worker : m_workers) {
+        std::lock_guard<std::mutex> lock{ worker->mutex };
+        worker->stopping = true;
+        worker->condition.notify_one();
+    }
+    for (auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+const bp_worker_device& bp_executor::get_worker_device(size_t index) const
+{
+    bp_validate_condition(index < m_workers.size(), "Worker index out of range.");
+    return m_workers[index]->device;
+}
+
+const platform::bp_device& bp_executor::get_platform_devices(size_t index) const
+{
+    bp_validate_condition(index < m_platforms.size(), "Platform index out of range.");
+    return *m_platforms[index].devices;
+}
+
+std::future<void> bp_executor::submit(size_t worker_index, bp_job job)
+{
+    bp_validate_condition(worker_index < m_workers.size(), "Worker index out of range.");
+    bp_worker& worker = *m_workers[worker_index];
+    return enqueue(worker, std::packaged_task<void()>{ [&worker, job]() {
+        job(worker.device);
+    } });
+}
+
+void bp_executor::run_on(size_t worker_index, const bp_job& job)
+{
+    std::vector<std::future<void>> futures{};
+    futures.push_back(submit(worker_index, job));
+    wait_for_jobs(futures);
+}
+
+void bp_executor::run_on_all(const bp_job& job)
+{
+    std::vector<std::future<void>> futures{};
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        futures.push_back(submit(i, job));
+    }
+    wait_for_jobs(futures);
+}
+
+void bp_executor::wait_for_jobs(std::vector<std::future<void>>& futures)
+{
+    // Every job is waited for before the first failure is reported, so none still runs when the process exits.
+    std::string error{};
+    for (auto& future : futures) {
+        try {
+            future.get();
+        } catch (const bp_error& job_error) {
+            if (error.empty()) {
+                error = job_error.what();
+            }
+        }
+    }
+    bp_validate_condition(error.empty(), error);
+}
+
+std::future<void> bp_executor::enqueue(bp_worker& worker, std::packaged_task<void()> task)
+{
+    std::future<void> future = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock{ worker.mutex };
+        worker.jobs.push_back(std::move(task));
+    }
+    worker.condition.notify_one();
+    return future;
+}
+
+void bp_executor::work(bp_worker& worker)
+{
+    is_worker_thread() = true;
+    capture::set_capture_device(worker.device.platform_index, worker.device.device_index);
+    while (true) {
+        std::packaged_task<void()> task{};
+        {
+            std::unique_lock<std::mutex> lock{ worker.mutex };
+            worker.condition.wait(lock, [&worker]() {
+                return worker.stopping || !worker.jobs.empty();
+            });
+            if (worker.jobs.empty()) {
+                return;
+            }
+            task = std::move(worker.jobs.front());
+            worker.jobs.pop_front();
+        }
+        task();
+    }
+}
+}
+}
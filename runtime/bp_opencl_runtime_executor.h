@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+
+namespace runtime {
+namespace executor {
+// The device a job runs on. The handles are owned by the executor.
+struct bp_worker_device {
+    size_t worker_index;
+    size_t platform_index;
+    size_t device_index;
+    cl_platform_id platform;
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue command_queue;
+};
+
+// Jobs of different workers run at the same time, so they must not share kernels, whose arguments are
+// per kernel object, or other state without a lock.
+using bp_job = std::function<void(const bp_worker_device&)>;
+
+// Runs one host thread per device. Platform devices and contexts are created in parallel, then every worker
+// creates the command queue of its device and runs the jobs submitted to it in order.
+class bp_executor {
+public:
+    explicit bp_executor(const platform::bp_platform&);
+    ~bp_executor();
+    bp_executor(const bp_executor&) = delete;
+    bp_executor& operator=(const bp_executor&) = delete;
+    bp_executor(bp_executor&&) = delete;
+    bp_executor& operator=(bp_executor&&) = delete;
+
+    size_t get_worker_number() const
+    {
+        return m_workers.size();
+    }
+
+    const bp_worker_device& get_worker_device(size_t) const;
+
+    const platform::bp_device& get_platform_devices(size_t) const;
+
+    // A failed condition in the job is rethrown as bp_error by the future.
+    std::future<void> submit(size_t worker_index, bp_job);
+
+    // Run and wait for the jobs, a failed condition in a job is reported on the calling thread.
+    void run_on(size_t worker_index, const bp_job&);
+
+    // Runs the job once on every device and waits for all of them.
+    void run_on_all(const bp_job&);
+private:
+    struct bp_platform_slot {
+        std::unique_ptr<platform::bp_device> devices;
+        std::unique_ptr<platform::bp_context> context;
+    };
+
+    struct bp_worker {
+        bp_worker_device device;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<std::packaged_task<void()>> jobs;
+        bool stopping;
+        std::thread thread;
+    };
+
+    std::future<void> enqueue(bp_worker&, std::packaged_task<void()>);
+    void work(bp_worker&);
+    static void wait_for_jobs(std::vector<std::future<void>>&);
+
+    std::vector<bp_platform_slot> m_platforms;
+    bp_cmdqueue m_cmdqueue;
+    std::vector<std::unique_ptr<bp_worker>> m_workers;
+};
+}
+}
@@ -0,0 +1,564 @@
+#include "bp_opencl_runtime_gemm.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+#include "bp_opencl_runtime_precision.h"
+#include "bp_opencl_runtime_roofline.h"
+
+constexpr size_t GEMM_TUNE_SIZE = 512;
+constexpr int GEMM_TUNE_REPEAT = 3;
+constexpr size_t GEMM_CHECK_SAMPLES = 64;
+
+// m x n x k products checked besides the square benchmark. The first fits every tile and takes the vector
+// loads, the second fits no tile, so every edge is bounds checked.
+static const std::vector<std::array<size_t, 3>> gemm_check_shapes{
+    { 128, 192, 64 },
+    { 67, 45, 93 }
+};
+
+// Ordered from the smallest footprint, so devices with few resources still get the first ones.
+static const std::vector<runtime::gemm::bp_gemm_params> gemm_params_candidates{
+    { 8, 8, 8, 1, 1, 1 },
+    { 16, 16, 16, 1, 1, 4 },
+    { 32, 32, 8, 4, 4, 4 },
+    { 32, 32, 16, 2, 2, 4 },
+    { 32, 32, 32, 4, 4, 8 },
+    { 64, 64, 8, 8, 8, 4 },
+    { 64, 64, 16, 4, 4, 4 }
+};
+
+static const std::vector<std::string> gemm_kernel_funcs{
+    "#if USE_DOUBLE\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#define REAL double\n"
+    "#else\n"
+    "#define REAL float\n"
+    "#endif\n"
+    "#define CONCAT_(a, b) a##b\n"
+    "#define CONCAT(a, b) CONCAT_(a, b)\n"
+    "#define VLOAD CONCAT(vload, VECTOR_WIDTH)\n"
+    "#define VSTORE CONCAT(vstore, VECTOR_WIDTH)\n"
+    "#define THREADS_M (TILE_M / WORK_M)\n"
+    "#define THREADS_N (TILE_N / WORK_N)\n"
+    "#define THREADS (THREADS_M * THREADS_N)\n"
+    "#if TRANS_A\n"
+    "#define A_INDEX(i, p) ((size_t)(p) * lda + (i))\n"
+    "#else\n"
+    "#define A_INDEX(i, p) ((size_t)(i) * lda + (p))\n"
+    "#endif\n"
+    "#if TRANS_B\n"
+    "#define B_INDEX(p, j) ((size_t)(j) * ldb + (p))\n"
+    "#else\n"
+    "#define B_INDEX(p, j) ((size_t)(p) * ldb + (j))\n"
+    "#endif\n"
+    "\n"
+    "__kernel __attribute__((reqd_work_group_size(THREADS_N, THREADS_M, 1)))\n"
+    "void gemm(uint m, uint n, uint k, REAL alpha, __global const REAL* a, uint lda, __global const REAL* b,\n"
+    "\tuint ldb, REAL beta, __global REAL* c, uint ldc)\n"
+    "{\n"
+    "\t__local REAL a_tile[TILE_K][TILE_M + 1];\n"
+    "\t__local REAL b_tile[TILE_K][TILE_N + 1];\n"
+    "\tuint tx = get_local_id(0);\n"
+    "\tuint ty = get_local_id(1);\n"
+    "\tuint tid = ty * THREADS_N + tx;\n"
+    "\tuint row0 = get_group_id(1) * TILE_M;\n"
+    "\tuint col0 = get_group_id(0) * TILE_N;\n"
+    "\tREAL acc[WORK_M][WORK_N];\n"
+    "\tfor (uint wm = 0; wm < WORK_M; ++wm) {\n"
+    "\t\tfor (uint wn = 0; wn < WORK_N; ++wn) {\n"
+    "\t\t\tacc[wm][wn] = 0;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\tfor (uint p0 = 0; p0 < k; p0 += TILE_K) {\n"
+    "#if VECTOR_LOADS && !TRANS_A\n"
+    "\t\tfor (uint idx = tid; idx < TILE_M * TILE_K / VECTOR_WIDTH; idx += THREADS) {\n"
+    "\t\t\tuint i = idx / (TILE_K / VECTOR_WIDTH);\n"
+    "\t\t\tuint p = idx % (TILE_K / VECTOR_WIDTH) * VECTOR_WIDTH;\n"
+    "\t\t\tREAL values[VECTOR_WIDTH];\n"
+    "\t\t\tVSTORE(VLOAD(0, a + A_INDEX(row0 + i, p0 + p)), 0, values);\n"
+    "\t\t\tfor (uint v = 0; v < VECTOR_WIDTH; ++v) {\n"
+    "\t\t\t\ta_tile[p + v][i] = values[v];\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "#else\n"
+    "\t\tfor (uint idx = tid; idx < TILE_M * TILE_K; idx += THREADS) {\n"
+    "#if TRANS_A\n"
+    "\t\t\tuint p = idx / TILE_M;\n"
+    "\t\t\tuint i = idx % TILE_M;\n"
+    "#else\n"
+    "\t\t\tuint i = idx / TILE_K;\n"
+    "\t\t\tuint p = idx % TILE_K;\n"
+    "#endif\n"
+    "\t\t\tuint gi = row0 + i;\n"
+    "\t\t\tuint gp = p0 + p;\n"
+    "\t\t\ta_tile[p][i] = gi < m && gp < k ? a[A_INDEX(gi, gp)] : (REAL)0;\n"
+    "\t\t}\n"
+    "#endif\n"
+    "#if VECTOR_LOADS && !TRANS_B\n"
+    "\t\tfor (uint idx = tid; idx < TILE_K * TILE_N / VECTOR_WIDTH; idx += THREADS) {\n"
+    "\t\t\tuint p = idx / (TILE_N / VECTOR_WIDTH);\n"
+    "\t\t\tuint j = idx % (TILE_N / VECTOR_WIDTH) * VECTOR_WIDTH;\n"
+    "\t\t\tVSTORE(VLOAD(0, b + B_INDEX(p0 + p, col0 + j)), 0, &b_tile[p][j]);\n"
+    "\t\t}\n"
+    "#else\n"
+    "\t\tfor (uint idx = tid; idx < TILE_K * TILE_N; idx += THREADS) {\n"
+    "#if TRANS_B\n"
+    "\t\t\tuint j = idx / TILE_K;\n"
+    "\t\t\tuint p = idx % TILE_K;\n"
+    "#else\n"
+    "\t\t\tuint p = idx / TILE_N;\n"
+    "\t\t\tuint j = idx % TILE_N;\n"
+    "#endif\n"
+    "\t\t\tuint gp = p0 + p;\n"
+    "\t\t\tuint gj = col0 + j;\n"
+    "\t\t\tb_tile[p][j] = gp < k && gj < n ? b[B_INDEX(gp, gj)] : (REAL)0;\n"
+    "\t\t}\n"
+    "#endif\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "\t\tfor (uint p = 0; p < TILE_K; ++p) {\n"
+    "\t\t\tREAL a_reg[WORK_M];\n"
+    "\t\t\tREAL b_reg[WORK_N];\n"
+    "\t\t\tfor (uint wm = 0; wm < WORK_M; ++wm) {\n"
+    "\t\t\t\ta_reg[wm] = a_tile[p][ty + wm * THREADS_M];\n"
+    "\t\t\t}\n"
+    "\t\t\tfor (uint wn = 0; wn < WORK_N; ++wn) {\n"
+    "\t\t\t\tb_reg[wn] = b_tile[p][tx + wn * THREADS_N];\n"
+    "\t\t\t}\n"
+    "\t\t\tfor (uint wm = 0; wm < WORK_M; ++wm) {\n"
+    "\t\t\t\tfor (uint wn = 0; wn < WORK_N; ++wn) {\n"
+    "\t\t\t\t\tacc[wm][wn] += a_reg[wm] * b_reg[wn];\n"
+    "\t\t\t\t}\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t}\n"
+    "\n"
+    "\tfor (uint wm = 0; wm < WORK_M; ++wm) {\n"
+    "\t\tuint gi = row0 + ty + wm * THREADS_M;\n"
+    "\t\tfor (uint wn = 0; wn < WORK_N; ++wn) {\n"
+    "\t\t\tuint gj = col0 + tx + wn * THREADS_N;\n"
+    "\t\t\tif (gi < m && gj < n) {\n"
+    "\t\t\t\tsize_t index = (size_t)gi * ldc + gj;\n"
+    "\t\t\t\tREAL value = alpha * acc[wm][wn];\n"
+    "\t\t\t\tc[index] = beta == 0 ? value : value + beta * c[index];\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t}\n"
+    "}"
+};
+
+// Tuners of several devices may share the cache file.
+static std::mutex gemm_cache_mutex;
+
+static void load_gemm_cache(std::map<std::string, runtime::gemm::bp_gemm_params>& params_cache)
+{
+    std::ifstream cache_file{ GEMM_CACHE_FILE };
+    std::string line;
+    while (std::getline(cache_file, line)) {
+        std::istringstream fields{ line };
+        std::string key;
+        runtime::gemm::bp_gemm_params params{};
+        if (std::getline(fields, key, '\t') && fields >> params.tile_m >> params.tile_n >> params.tile_k >>
+            params.work_m >> params.work_n >> params.vector_width) {
+            params_cache[key] = params;
+        }
+    }
+}
+
+// Cached parameters may come from an older build or an edited file, so they must describe a kernel that builds:
+// work blocks tile the work group tile and vector loads split the tile rows.
+static bool is_valid_params(const runtime::gemm::bp_gemm_params& params)
+{
+    const std::array<size_t, 5> vector_widths{ 1, 2, 4, 8, 16 };
+    if (params.tile_m == 0 || params.tile_n == 0 || params.tile_k == 0 || params.work_m == 0 || params.work_n == 0 ||
+        std::find(vector_widths.begin(), vector_widths.end(), params.vector_width) == vector_widths.end()) {
+        return false;
+    }
+    return params.tile_m % params.work_m == 0 && params.tile_n % params.work_n == 0 &&
+        params.tile_k % params.vector_width == 0 && params.tile_n % params.vector_width == 0;
+}
+
+static std::string get_params_key(const std::string& device_key, bool is_double)
+{
+    return device_key + (is_double ? " / double" : " / float");
+}
+
+static size_t get_local_mem_size(const runtime::gemm::bp_gemm_params& params, bool is_double)
+{
+    return params.tile_k * (params.tile_m + 1 + params.tile_n + 1) * (is_double ? sizeof(cl_double) : sizeof(cl_float));
+}
+
+static cl_uint to_kernel_uint(size_t value)
+{
+    bp_validate_condition(value <= std::numeric_limits<cl_uint>::max(), "Matrix dimension too large.");
+    return static_cast<cl_uint>(value);
+}
+
+namespace runtime {
+namespace gemm {
+bp_gemm::bp_gemm(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device) :
+    m_context{ context }, m_device{ device }, m_device_key{ platform::get_device_key(device) }, m_program{},
+    m_kernel{}, m_cmdqueue{}, m_kernels{}, m_params{}
+{
+    std::lock_guard<std::mutex> lock{ gemm_cache_mutex };
+    load_gemm_cache(m_params);
+}
+
+bool bp_gemm::is_supported(const bp_gemm_params& params, bool is_double) const
+{
+    auto max_work_item_dimensions = platform::get_device_info_single_type<cl_uint>(m_device,
+        CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS);
+    std::vector<size_t> max_work_item_sizes(max_work_item_dimensions);
+    cl_int err = clGetDeviceInfo(m_device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(size_t) * max_work_item_sizes.size(),
+        max_work_item_sizes.data(), nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get device info failed.");
+    auto max_work_group_size = platform::get_device_info_single_type<size_t>(m_device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    auto local_mem_size = platform::get_device_info_single_type<cl_ulong>(m_device, CL_DEVICE_LOCAL_MEM_SIZE);
+
+    size_t threads_m = params.tile_m / params.work_m;
+    size_t threads_n = params.tile_n / params.work_n;
+    return threads_n <= max_work_item_sizes[0] && threads_m <= max_work_item_sizes[1] &&
+        threads_m * threads_n <= max_work_group_size && get_local_mem_size(params, is_double) <= local_mem_size;
+}
+
+cl_kernel bp_gemm::get_kernel(const bp_gemm_params& params, const bp_gemm_call& call, bool vector_loads)
+{
+    std::string options = std::string{ "-D USE_DOUBLE=" } + (call.is_double ? "1" : "0") +
+        " -D TILE_M=" + std::to_string(params.tile_m) + " -D TILE_N=" + std::to_string(params.tile_n) +
+        " -D TILE_K=" + std::to_string(params.tile_k) + " -D WORK_M=" + std::to_string(params.work_m) +
+        " -D WORK_N=" + std::to_string(params.work_n) + " -D VECTOR_WIDTH=" + std::to_string(params.vector_width) +
+        " -D VECTOR_LOADS=" + (vector_loads ? "1" : "0") +
+        " -D TRANS_A=" + (call.trans_a == bp_gemm_transpose::transpose ? "1" : "0") +
+        " -D TRANS_B=" + (call.trans_b == bp_gemm_transpose::transpose ? "1" : "0");
+    auto iter = m_kernels.find(options);
+    if (iter != m_kernels.end()) {
+        return iter->second;
+    }
+
+    cl_program program = m_program.create_program_with_source(m_context, gemm_kernel_funcs,
+        std::vector<cl_device_id>{ m_device }, options);
+    cl_kernel kernel = m_kernel.create_kernel(program, "gemm");
+    return m_kernels.emplace(options, kernel).first->second;
+}
+
+cl_ulong bp_gemm::run(gsl::not_null<cl_command_queue> command_queue, const bp_gemm_params& params,
+    const bp_gemm_call& call)
+{
+    // Vector loads skip the bounds checks, so every tile has to lie inside the matrices.
+    bool vector_loads = params.vector_width > 1 && call.m % params.tile_m == 0 && call.n % params.tile_n == 0 &&
+        call.k % params.tile_k == 0;
+    cl_kernel kernel = get_kernel(params, call, vector_loads);
+
+    size_t threads_m = params.tile_m / params.work_m;
+    size_t threads_n = params.tile_n / params.work_n;
+    size_t max_size;
+    cl_int err = clGetKernelWorkGroupInfo(kernel, m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_size,
+        nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get kernel work group info failed.");
+    bp_validate_condition(threads_m * threads_n <= max_size, "GEMM work group too large for kernel.");
+
+    cl_uint m = to_kernel_uint(call.m);
+    cl_uint n = to_kernel_uint(call.n);
+    cl_uint k = to_kernel_uint(call.k);
+    cl_uint lda = to_kernel_uint(call.lda);
+    cl_uint ldb = to_kernel_uint(call.ldb);
+    cl_uint ldc = to_kernel_uint(call.ldc);
+    size_t real_size = call.is_double ? sizeof(cl_double) : sizeof(cl_float);
+    set_arg(kernel, 0, sizeof(cl_uint), &m);
+    set_arg(kernel, 1, sizeof(cl_uint), &n);
+    set_arg(kernel, 2, sizeof(cl_uint), &k);
+    set_arg(kernel, 3, real_size, call.alpha);
+    set_arg(kernel, 4, call.a);
+    set_arg(kernel, 5, sizeof(cl_uint), &lda);
+    set_arg(kernel, 6, call.b);
+    set_arg(kernel, 7, sizeof(cl_uint), &ldb);
+    set_arg(kernel, 8, real_size, call.beta);
+    set_arg(kernel, 9, call.c);
+    set_arg(kernel, 10, sizeof(cl_uint), &ldc);
+
+    size_t groups_m = (call.m + params.tile_m - 1) / params.tile_m;
+    size_t groups_n = (call.n + params.tile_n - 1) / params.tile_n;
+    bp_ndrange range{ 2, { 0, 0, 0 }, { groups_n * threads_n, groups_m * threads_m, 1 }, { threads_n, threads_m, 1 } };
+    return m_cmdqueue.enqueue_kernel(command_queue, kernel, range);
+}
+
+cl_ulong bp_gemm::gemm(gsl::not_null<cl_command_queue> command_queue, bp_gemm_layout layout, bp_gemm_call call)
+{
+    if (call.is_double) {
+        bp_validate_condition(precision::bp_precision_policy::device_supports_double(m_device),
+            "Device doesn't support double.");
+    }
+
+    // A column major matrix read as row major is its transpose, so C^T = op(B)^T * op(A)^T is computed instead.
+    if (layout == bp_gemm_layout::column_major) {
+        std::swap(call.m, call.n);
+        std::swap(call.a, call.b);
+        std::swap(call.lda, call.ldb);
+        std::swap(call.trans_a, call.trans_b);
+    }
+    bp_validate_condition(call.lda >= (call.trans_a == bp_gemm_transpose::transpose ? call.m : call.k) &&
+        call.ldb >= (call.trans_b == bp_gemm_transpose::transpose ? call.k : call.n) && call.ldc >= call.n,
+        "Leading dimension too small.");
+    if (call.m == 0 || call.n == 0) {
+        return 0;
+    }
+
+    bp_gemm_params params = get_params(command_queue, call.is_double);
+    return run(command_queue, params, call);
+}
+
+cl_ulong bp_gemm::sgemm(gsl::not_null<cl_command_queue> command_queue, bp_gemm_layout layout,
+    bp_gemm_transpose trans_a, bp_gemm_transpose trans_b, size_t m, size_t n, size_t k, cl_float alpha,
+    gsl::not_null<cl_mem> a, size_t lda, gsl::not_null<cl_mem> b, size_t ldb, cl_float beta, gsl::not_null<cl_mem> c,
+    size_t ldc)
+{
+    return gemm(command_queue, layout, { false, trans_a, trans_b, m, n, k, &alpha, a, lda, b, ldb, &beta, c, ldc });
+}
+
+cl_ulong bp_gemm::dgemm(gsl::not_null<cl_command_queue> command_queue, bp_gemm_layout layout,
+    bp_gemm_transpose trans_a, bp_gemm_transpose trans_b, size_t m, size_t n, size_t k, cl_double alpha,
+    gsl::not_null<cl_mem> a, size_t lda, gsl::not_null<cl_mem> b, size_t ldb, cl_double beta, gsl::not_null<cl_mem> c,
+    size_t ldc)
+{
+    return gemm(command_queue, layout, { true, trans_a, trans_b, m, n, k, &alpha, a, lda, b, ldb, &beta, c, ldc });
+}
+
+const bp_gemm_params& bp_gemm::get_params(gsl::not_null<cl_command_queue> command_queue, bool is_double)
+{
+    std::string key = get_params_key(m_device_key, is_double);
+    auto iter = m_params.find(key);
+    if (iter != m_params.end() && (!is_valid_params(iter->second) || !is_supported(iter->second, is_double))) {
+        bp_print_info(true, "Ignore invalid cached GEMM parameters of ", key);
+        iter = m_params.end();
+    }
+    if (iter == m_params.end()) {
+        tune(command_queue, is_double);
+        iter = m_params.find(key);
+    } else {
+        bp_print_info(true, "Use cached GEMM parameters of ", key);
+    }
+    return iter->second;
+}
+
+void bp_gemm::tune(gsl::not_null<cl_command_queue> command_queue, bool is_double)
+{
+    size_t real_size = is_double ? sizeof(cl_double) : sizeof(cl_float);
+    size_t bytes = real_size * GEMM_TUNE_SIZE * GEMM_TUNE_SIZE;
+    std::vector<char> zeros(bytes, 0);
+    memory::bp_memory bp_memory{};
+    cl_mem a = bp_memory.create_buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, zeros.data());
+    cl_mem b = bp_memory.create_buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, zeros.data());
+    cl_mem c = bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, zeros.data());
+    cl_double alpha = 1.0;
+    cl_double beta = 0.0;
+    cl_float alpha_float = 1.0f;
+    cl_float beta_float = 0.0f;
+    bp_gemm_call call{ is_double, bp_gemm_transpose::none, bp_gemm_transpose::none, GEMM_TUNE_SIZE, GEMM_TUNE_SIZE,
+        GEMM_TUNE_SIZE, is_double ? static_cast<const void*>(&alpha) : &alpha_float, a, GEMM_TUNE_SIZE, b,
+        GEMM_TUNE_SIZE, is_double ? static_cast<const void*>(&beta) : &beta_float, c, GEMM_TUNE_SIZE };
+
+    // The first run of a candidate also builds its kernel, so the best of a few runs is taken.
+    const bp_gemm_params* best_params = nullptr;
+    cl_ulong best_time = 0;
+    for (const auto& params : gemm_params_candidates) {
+        if (!is_supported(params, is_double)) {
+            continue;
+        }
+        cl_ulong elapsed_time = 0;
+        for (auto i = 0; i < GEMM_TUNE_REPEAT; ++i) {
+            cl_ulong time = run(command_queue, params, call);
+            if (i == 0 || time < elapsed_time) {
+                elapsed_time = time;
+            }
+        }
+        double gflops = elapsed_time == 0 ? 0.0 : 2.0 * GEMM_TUNE_SIZE * GEMM_TUNE_SIZE * GEMM_TUNE_SIZE / elapsed_time;
+        bp_print_info(true, "GEMM tile ", params.tile_m, "x", params.tile_n, "x", params.tile_k, ", work ",
+            params.work_m, "x", params.work_n, ", vector ", params.vector_width, ": ", gflops, " GFLOP/s");
+        if (best_params == nullptr || elapsed_time < best_time) {
+            best_params = &params;
+            best_time = elapsed_time;
+        }
+    }
+    bp_validate_condition(best_params != nullptr, "No GEMM parameters fit the device.");
+
+    std::string key = get_params_key(m_device_key, is_double);
+    m_params[key] = *best_params;
+    bp_print_info(true, "Best GEMM tile of ", key, " is ", best_params->tile_m, "x", best_params->tile_n, "x",
+        best_params->tile_k, ", work ", best_params->work_m, "x", best_params->work_n, ", vector ",
+        best_params->vector_width);
+    save_cache();
+}
+
+void bp_gemm::save_cache() const
+{
+    // Entries tuned by other instances since this one loaded the file are kept.
+    std::lock_guard<std::mutex> lock{ gemm_cache_mutex };
+    std::map<std::string, bp_gemm_params> params_cache{};
+    load_gemm_cache(params_cache);
+    for (const auto& key_params : m_params) {
+        params_cache[key_params.first] = key_params.second;
+    }
+
+    std::ofstream cache_file{ GEMM_CACHE_FILE };
+    for (const auto& key_params : params_cache) {
+        const auto& params = key_params.second;
+        cache_file << key_params.first << '\t' << params.tile_m << ' ' << params.tile_n << ' ' << params.tile_k << ' '
+            << params.work_m << ' ' << params.work_n << ' ' << params.vector_width << '\n';
+    }
+}
+
+// Host reference of one entry of alpha * op(A) * op(B) + beta * C, with the magnitude of its terms
+// that bounds the rounding error.
+template<typename T>
+static std::pair<double, double> reference_entry(const std::vector<T>& a, size_t lda, const std::vector<T>& b,
+    size_t ldb, const std::vector<T>& c, size_t ldc, bool column_major, bool trans_a, bool trans_b, size_t k,
+    size_t i, size_t j, double alpha, double beta)
+{
+    auto at = [column_major](const std::vector<T>& matrix, size_t ld, size_t row, size_t col) -> double {
+        return column_major ? matrix[col * ld + row] : matrix[row * ld + col];
+    };
+    double sum = 0.0;
+    double magnitude = 0.0;
+    for (size_t p = 0; p < k; ++p) {
+        double product = (trans_a ? at(a, lda, p, i) : at(a, lda, i, p)) *
+            (trans_b ? at(b, ldb, j, p) : at(b, ldb, p, j));
+        sum += product;
+        magnitude += std::abs(product);
+    }
+    double c_entry = at(c, ldc, i, j);
+    return { alpha * sum + beta * c_entry, std::abs(alpha) * magnitude + std::abs(beta * c_entry) };
+}
+
+// Every matrix has its own generator, so no matrix repeats or scales another.
+template<typename T>
+static std::vector<T> get_random_matrix(size_t count, std::mt19937::result_type seed, T bottom, T top)
+{
+    std::mt19937 generator{ seed };
+    std::uniform_real_distribution<T> distribution{ bottom, top };
+    std::vector<T> matrix(count);
+    for (auto& entry : matrix) {
+        entry = distribution(generator);
+    }
+    return matrix;
+}
+
+// Runs an m x n x k product for every transpose pair on both layouts, checks sampled entries against the host
+// reference and returns the best kernel time.
+template<typename T>
+static cl_ulong check_gemm(bp_gemm& bp_gemm, gsl::not_null<cl_context> context,
+    gsl::not_null<cl_command_queue> command_queue, size_t m, size_t n, size_t k)
+{
+    constexpr bool is_double = std::is_same<T, cl_double>::value;
+    std::vector<T> a = get_random_matrix<T>(m * k, 1, static_cast<T>(-1), static_cast<T>(1));
+    std::vector<T> b = get_random_matrix<T>(k * n, 2, static_cast<T>(-2), static_cast<T>(2));
+    std::vector<T> c = get_random_matrix<T>(m * n, 3, static_cast<T>(0), static_cast<T>(1));
+
+    memory::bp_memory bp_memory{};
+    cl_mem a_mem = bp_memory.create_buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(T) * a.size(),
+        a.data());
+    cl_mem b_mem = bp_memory.create_buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(T) * b.size(),
+        b.data());
+    cl_mem c_mem = bp_memory.create_buffer(context, CL_MEM_READ_WRITE, sizeof(T) * c.size(), nullptr);
+
+    const T alpha = static_cast<T>(1.5);
+    const T beta = static_cast<T>(0.5);
+    const double tolerance = 2.0 * k * std::numeric_limits<T>::epsilon();
+    std::mt19937 generator{ 0 };
+    std::uniform_int_distribution<size_t> row_distribution{ 0, m - 1 };
+    std::uniform_int_distribution<size_t> col_distribution{ 0, n - 1 };
+    std::vector<T> result(c.size());
+    cl_ulong best_time = 0;
+    for (auto layout : { bp_gemm_layout::row_major, bp_gemm_layout::column_major }) {
+        bool column_major = layout == bp_gemm_layout::column_major;
+        for (auto trans_a : { bp_gemm_transpose::none, bp_gemm_transpose::transpose }) {
+            for (auto trans_b : { bp_gemm_transpose::none, bp_gemm_transpose::transpose }) {
+                // The stored matrices are op(A) and op(B) or their transposes, the leading dimension is the
+                // length of a stored row, or of a stored column on the column major layout.
+                bool transpose_a = trans_a == bp_gemm_transpose::transpose;
+                bool transpose_b = trans_b == bp_gemm_transpose::transpose;
+                size_t lda = column_major == transpose_a ? k : m;
+                size_t ldb = column_major == transpose_b ? n : k;
+                size_t ldc = column_major ? m : n;
+
+                bp_memory.write_buffer(command_queue, c_mem, sizeof(T) * c.size(), c.data(),
+                    memory::bp_transfer_method::copy);
+                cl_ulong elapsed_time;
+                if (is_double) {
+                    elapsed_time = bp_gemm.dgemm(command_queue, layout, trans_a, trans_b, m, n, k, alpha, a_mem, lda,
+                        b_mem, ldb, beta, c_mem, ldc);
+                } else {
+                    elapsed_time = bp_gemm.sgemm(command_queue, layout, trans_a, trans_b, m, n, k,
+                        static_cast<cl_float>(alpha), a_mem, lda, b_mem, ldb, static_cast<cl_float>(beta), c_mem,
+                        ldc);
+                }
+                if (best_time == 0 || elapsed_time < best_time) {
+                    best_time = elapsed_time;
+                }
+                bp_memory.read_buffer(command_queue, c_mem, sizeof(T) * c.size(), result.data(),
+                    memory::bp_transfer_method::copy);
+
+                for (size_t sample = 0; sample < GEMM_CHECK_SAMPLES; ++sample) {
+                    size_t i = row_distribution(generator);
+                    size_t j = col_distribution(generator);
+                    auto expected = reference_entry(a, lda, b, ldb, c, ldc, column_major, transpose_a, transpose_b,
+                        k, i, j, alpha, beta);
+                    double value = column_major ? result[j * ldc + i] : result[i * ldc + j];
+                    bp_validate_condition(std::abs(value - expected.first) <= tolerance * expected.second,
+                        "GEMM result is wrong.");
+                }
+            }
+        }
+    }
+    return best_time;
+}
+
+template<typename T>
+static void benchmark_gemm_type(bp_gemm& bp_gemm, gsl::not_null<cl_context> context,
+    gsl::not_null<cl_device_id> device, gsl::not_null<cl_command_queue> command_queue, size_t size)
+{
+    constexpr bool is_double = std::is_same<T, cl_double>::value;
+    for (const auto& shape : gemm_check_shapes) {
+        check_gemm<T>(bp_gemm, context, command_queue, shape[0], shape[1], shape[2]);
+        bp_print_info(true, is_double ? "DGEMM" : "SGEMM", " of ", shape[0], "x", shape[1], "x", shape[2],
+            " is correct.");
+    }
+
+    cl_ulong best_time = check_gemm<T>(bp_gemm, context, command_queue, size, size, size);
+    double gflops = best_time == 0 ? 0.0 : 2.0 * size * size * size / best_time;
+    double peak = roofline::measure_peak_compute(context, device, command_queue, is_double);
+    bp_print_info(true, is_double ? "DGEMM" : "SGEMM", " of ", size, "x", size, ": ", gflops, " GFLOP/s, peak ",
+        peak, " GFLOP/s, ", peak == 0.0 ? 0.0 : 100.0 * gflops / peak, " %");
+}
+
+void benchmark_gemm(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, size_t size)
+{
+    bp_gemm bp_gemm{ context, device };
+    benchmark_gemm_type<cl_float>(bp_gemm, context, device, command_queue, size);
+    if (precision::bp_precision_policy::device_supports_double(device)) {
+        benchmark_gemm_type<cl_double>(bp_gemm, context, device, command_queue, size);
+    }
+}
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+
+namespace runtime {
+namespace gemm {
+enum class bp_gemm_layout {
+    row_major,
+    column_major
+};
+
+enum class bp_gemm_transpose {
+    none,
+    transpose
+};
+
+// A work group computes a tile_m x tile_n block of C, staging tile_k wide slices of A and B in __local memory.
+// Each work item accumulates a work_m x work_n block in registers. Vector loads of vector_width elements are
+// used when the operands are aligned to the tiles.
+struct bp_gemm_params {
+    size_t tile_m;
+    size_t tile_n;
+    size_t tile_k;
+    size_t work_m;
+    size_t work_n;
+    size_t vector_width;
+};
+
+// C = alpha * op(A) * op(B) + beta * C on device buffers. Tile parameters are tuned per device and precision
+// on first use, then cached in GEMM_CACHE_FILE.
+class bp_gemm {
+public:
+    bp_gemm(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>);
+    bp_gemm(const bp_gemm&) = delete;
+    bp_gemm& operator=(const bp_gemm&) = delete;
+    bp_gemm(bp_gemm&&) = delete;
+    bp_gemm& operator=(bp_gemm&&) = delete;
+
+    const bp_gemm_params& get_params(gsl::not_null<cl_command_queue>, bool is_double);
+
+    // Return the kernel time in nanoseconds.
+    cl_ulong sgemm(gsl::not_null<cl_command_queue>, bp_gemm_layout, bp_gemm_transpose trans_a,
+        bp_gemm_transpose trans_b, size_t m, size_t n, size_t k, cl_float alpha, gsl::not_null<cl_mem> a, size_t lda,
+        gsl::not_null<cl_mem> b, size_t ldb, cl_float beta, gsl::not_null<cl_mem> c, size_t ldc);
+    cl_ulong dgemm(gsl::not_null<cl_command_queue>, bp_gemm_layout, bp_gemm_transpose trans_a,
+        bp_gemm_transpose trans_b, size_t m, size_t n, size_t k, cl_double alpha, gsl::not_null<cl_mem> a, size_t lda,
+        gsl::not_null<cl_mem> b, size_t ldb, cl_double beta, gsl::not_null<cl_mem> c, size_t ldc);
+private:
+    struct bp_gemm_call {
+        bool is_double;
+        bp_gemm_transpose trans_a;
+        bp_gemm_transpose trans_b;
+        size_t m;
+        size_t n;
+        size_t k;
+        const void* alpha;
+        cl_mem a;
+        size_t lda;
+        cl_mem b;
+        size_t ldb;
+        const void* beta;
+        cl_mem c;
+        size_t ldc;
+    };
+
+    bool is_supported(const bp_gemm_params&, bool is_double) const;
+    cl_kernel get_kernel(const bp_gemm_params&, const bp_gemm_call&, bool vector_loads);
+    cl_ulong run(gsl::not_null<cl_command_queue>, const bp_gemm_params&, const bp_gemm_call&);
+    cl_ulong gemm(gsl::not_null<cl_command_queue>, bp_gemm_layout, bp_gemm_call);
+    void tune(gsl::not_null<cl_command_queue>, bool is_double);
+    void save_cache() const;
+
+    cl_context m_context;
+    cl_device_id m_device;
+    std::string m_device_key;
+    bp_program m_program;
+    bp_kernel m_kernel;
+    bp_cmdqueue m_cmdqueue;
+    std::map<std::string, cl_kernel> m_kernels;
+    std::map<std::string, bp_gemm_params> m_params;
+};
+
+// Runs sgemm, and dgemm on fp64 devices, on non-square and square matrices, checks sampled entries against
+// a host reference and reports GFLOP/s of the square case against the device peak.
+void benchmark_gemm(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+    size_t size);
+}
+}
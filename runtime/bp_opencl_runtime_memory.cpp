@@ -1,24 +1,420 @@
 #include "bp_opencl_runtime_memory.h"
 
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <vector>
+#include <algorithm>
 #include <gsl/pointers>
 
 #include "CL/opencl.h"
 
 #include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime_capture.h"
+
+constexpr size_t TRANSFER_PROBE_REPEAT = 3;
+
+// Host pointer buffers are only used in place when their storage is aligned, page alignment suits most drivers.
+constexpr size_t TRANSFER_HOST_ALIGNMENT = 4096;
+
+static const std::vector<size_t> transfer_probe_sizes{
+    1 << 16,
+    1 << 20,
+    1 << 24
+};
+
+static const std::vector<runtime::memory::bp_allocation> transfer_allocations{
+    runtime::memory::bp_allocation::device,
+    runtime::memory::bp_allocation::alloc_host_ptr,
+    runtime::memory::bp_allocation::use_host_ptr
+};
+
+static const std::vector<runtime::memory::bp_transfer_method> transfer_methods{
+    runtime::memory::bp_transfer_method::copy,
+    runtime::memory::bp_transfer_method::map
+};
+
+template<typename T>
+static bool is_listed(const std::vector<T>& values, int value)
+{
+    return std::any_of(values.begin(), values.end(), [value](T listed) {
+        return static_cast<int>(listed) == value;
+    });
+}
 
 namespace runtime {
 namespace memory {
+const char* get_allocation_name(bp_allocation allocation)
+{
+    switch (allocation) {
+        case bp_allocation::device:
+            return "device memory";
+        case bp_allocation::alloc_host_ptr:
+            return "CL_MEM_ALLOC_HOST_PTR";
+        case bp_allocation::use_host_ptr:
+            return "CL_MEM_USE_HOST_PTR";
+        default:
+            return "unknown";
+    }
+}
+
+const char* get_transfer_method_name(bp_transfer_method method)
+{
+    switch (method) {
+        case bp_transfer_method::copy:
+            return "copy";
+        case bp_transfer_method::map:
+            return "map";
+        default:
+            return "unknown";
+    }
+}
+
 cl_mem bp_memory::create_buffer(gsl::not_null<cl_context> context, cl_mem_flags flags, size_t size, void* host_ptr)
 {
     cl_int err;
     cl_mem buffer = clCreateBuffer(context, flags, size, host_ptr, &err);
     bp_validate_condition(err == CL_SUCCESS, "Create buffer failed.");
     bp_print_info(true, "Successfully create buffer.");
+    capture::record_buffer(buffer, flags, size, host_ptr);
 
     m_memories.push_back(buffer);
 
     return buffer;
 }
+
+cl_mem bp_memory::create_buffer(gsl::not_null<cl_context> context, cl_mem_flags flags, size_t size, void* host_ptr,
+    bp_allocation allocation)
+{
+    switch (allocation) {
+        case bp_allocation::use_host_ptr:
+            bp_validate_condition(host_ptr != nullptr, "CL_MEM_USE_HOST_PTR needs a host pointer.");
+            return create_buffer(context, flags | CL_MEM_USE_HOST_PTR, size, host_ptr);
+        case bp_allocation::alloc_host_ptr:
+            flags |= CL_MEM_ALLOC_HOST_PTR;
+            break;
+        case bp_allocation::device:
+        default:
+            break;
+    }
+    if (host_ptr != nullptr) {
+        flags |= CL_MEM_COPY_HOST_PTR;
+    }
+    return create_buffer(context, flags, size, host_ptr);
+}
+
+// Releases are recorded first, a handle freed by the driver may be reused by the next object at once.
+bp_memory::~bp_memory()
+{
+    for (auto sampler : m_samplers) {
+        capture::record_release(sampler);
+        cl_int err = clReleaseSampler(sampler);
+        bp_validate_release(err == CL_SUCCESS, "Release sampler failed.");
+    }
+    for (auto memory : m_memories) {
+        capture::record_release(memory);
+        cl_int err = clReleaseMemObject(memory);
+        bp_validate_release(err == CL_SUCCESS, "Release memory object failed.");
+    }
+}
+
+void bp_memory::release(gsl::not_null<cl_mem> memory)
+{
+    auto iter = std::find(m_memories.begin(), m_memories.end(), memory.get());
+    bp_validate_condition(iter != m_memories.end(), "Memory object isn't owned.");
+    m_memories.erase(iter);
+    capture::record_release(memory);
+    cl_int err = clReleaseMemObject(memory);
+    bp_validate_condition(err == CL_SUCCESS, "Release memory object failed.");
+}
+
+void bp_memory::release(gsl::not_null<cl_sampler> sampler)
+{
+    auto iter = std::find(m_samplers.begin(), m_samplers.end(), sampler.get());
+    bp_validate_condition(iter != m_samplers.end(), "Sampler isn't owned.");
+    m_samplers.erase(iter);
+    capture::record_release(sampler);
+    cl_int err = clReleaseSampler(sampler);
+    bp_validate_condition(err == CL_SUCCESS, "Release sampler failed.");
+}
+
+void bp_memory::write_buffer(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_mem> buffer, size_t size,
+    const void* host_ptr, bp_transfer_method method) const
+{
+    capture::record_write_buffer(buffer, size, host_ptr);
+    cl_int err;
+    if (method == bp_transfer_method::copy) {
+        err = clEnqueueWriteBuffer(command_queue, buffer, CL_TRUE, 0, size, host_ptr, 0, nullptr, nullptr);
+        bp_validate_condition(err == CL_SUCCESS, "Write buffer failed.");
+        return;
+    }
+
+    // The copy is skipped when the map hands back host_ptr, as it does for CL_MEM_USE_HOST_PTR buffers wrapping it.
+    void* mapped = clEnqueueMapBuffer(command_queue, buffer, CL_TRUE, CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &err);
+    bp_validate_condition(err == CL_SUCCESS, "Map buffer failed.");
+    if (mapped != host_ptr) {
+        std::memcpy(mapped, host_ptr, size);
+    }
+    err = clEnqueueUnmapMemObject(command_queue, buffer, mapped, 0, nullptr, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Unmap buffer failed.");
+    err = clFinish(command_queue);
+    bp_validate_condition(err == CL_SUCCESS, "Finish command queue failed.");
+}
+
+void bp_memory::read_buffer(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_mem> buffer, size_t size,
+    void* host_ptr, bp_transfer_method method) const
+{
+    capture::record_read_buffer(buffer, size);
+    cl_int err;
+    if (method == bp_transfer_method::copy) {
+        err = clEnqueueReadBuffer(command_queue, buffer, CL_TRUE, 0, size, host_ptr, 0, nullptr, nullptr);
+        bp_validate_condition(err == CL_SUCCESS, "Read buffer failed.");
+        return;
+    }
+
+    void* mapped = clEnqueueMapBuffer(command_queue, buffer, CL_TRUE, CL_MAP_READ, 0, size, 0, nullptr, nullptr, &err);
+    bp_validate_condition(err == CL_SUCCESS, "Map buffer failed.");
+    if (mapped != host_ptr) {
+        std::memcpy(host_ptr, mapped, size);
+    }
+    err = clEnqueueUnmapMemObject(command_queue, buffer, mapped, 0, nullptr, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Unmap buffer failed.");
+    err = clFinish(command_queue);
+    bp_validate_condition(err == CL_SUCCESS, "Finish command queue failed.");
+}
+
+bool is_image_format_supported(gsl::not_null<cl_context> context, cl_mem_flags flags, cl_mem_object_type image_type,
+    const cl_image_format& format)
+{
+    cl_uint num_formats;
+    cl_int err = clGetSupportedImageFormats(context, flags, image_type, 0, nullptr, &num_formats);
+    bp_validate_condition(err == CL_SUCCESS, "Get supported image formats failed.");
+    auto formats(std::make_unique<cl_image_format[]>(num_formats));
+    err = clGetSupportedImageFormats(context, flags, image_type, num_formats, formats.get(), nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get supported image formats failed.");
+
+    for (auto i = 0; i < num_formats; ++i) {
+        if (formats[i].image_channel_order == format.image_channel_order &&
+            formats[i].image_channel_data_type == format.image_channel_data_type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+cl_mem bp_memory::create_image(gsl::not_null<cl_context> context, cl_mem_flags flags, const cl_image_format& format,
+    const cl_image_desc& desc, void* host_ptr)
+{
+    bp_validate_condition(is_image_format_supported(context, flags, desc.image_type, format),
+        "Image format isn't supported.");
+    if (host_ptr != nullptr) {
+        flags |= CL_MEM_COPY_HOST_PTR;
+    }
+
+    cl_int err;
+    cl_mem image = clCreateImage(context, flags, &format, &desc, host_ptr, &err);
+    bp_validate_condition(err == CL_SUCCESS, "Create image failed.");
+    bp_print_info(true, "Successfully create image.");
+    capture::record_image(image, flags, format, desc, host_ptr);
+
+    m_memories.push_back(image);
+
+    return image;
+}
+
+cl_mem bp_memory::create_image_2d(gsl::not_null<cl_context> context, cl_mem_flags flags, const cl_image_format& format,
+    size_t width, size_t height, void* host_ptr)
+{
+    cl_image_desc desc{};
+    desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width = width;
+    desc.image_height = height;
+    return create_image(context, flags, format, desc, host_ptr);
+}
+
+cl_mem bp_memory::create_image_3d(gsl::not_null<cl_context> context, cl_mem_flags flags, const cl_image_format& format,
+    size_t width, size_t height, size_t depth, void* host_ptr)
+{
+    cl_image_desc desc{};
+    desc.image_type = CL_MEM_OBJECT_IMAGE3D;
+    desc.image_width = width;
+    desc.image_height = height;
+    desc.image_depth = depth;
+    return create_image(context, flags, format, desc, host_ptr);
+}
+
+cl_sampler bp_memory::create_sampler(gsl::not_null<cl_context> context, bool normalized_coords,
+    cl_addressing_mode addressing_mode, cl_filter_mode filter_mode)
+{
+    cl_int err;
+    cl_sampler sampler = clCreateSampler(context, normalized_coords ? CL_TRUE : CL_FALSE, addressing_mode, filter_mode, &err);
+    bp_validate_condition(err == CL_SUCCESS, "Create sampler failed.");
+    bp_print_info(true, "Successfully create sampler.");
+    capture::record_sampler(sampler, normalized_coords, addressing_mode, filter_mode);
+
+    m_samplers.push_back(sampler);
+
+    return sampler;
+}
+
+void bp_memory::write_image(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_mem> image,
+    const size_t* region, const void* host_ptr) const
+{
+    capture::record_write_image(image, region, host_ptr);
+    const size_t origin[3] = { 0, 0, 0 };
+    cl_int err = clEnqueueWriteImage(command_queue, image, CL_TRUE, origin, region, 0, 0, host_ptr, 0, nullptr, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Write image failed.");
+}
+
+void bp_memory::read_image(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_mem> image,
+    const size_t* region, void* host_ptr) const
+{
+    const size_t origin[3] = { 0, 0, 0 };
+    cl_int err = clEnqueueReadImage(command_queue, image, CL_TRUE, origin, region, 0, 0, host_ptr, 0, nullptr, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Read image failed.");
+}
+
+bp_transfer_policy::bp_transfer_policy() : m_mutex{}, m_strategies{}
+{
+    std::ifstream cache_file{ TRANSFER_CACHE_FILE };
+    std::string line;
+    std::vector<std::string> invalid_keys{};
+    while (std::getline(cache_file, line)) {
+        std::istringstream fields{ line };
+        std::string key;
+        size_t size;
+        int write_allocation, write_method, read_allocation, read_method;
+        if (std::getline(fields, key, '\t') && fields >> size >> write_allocation >> write_method >> read_allocation >>
+            read_method) {
+            if (!is_listed(transfer_allocations, write_allocation) || !is_listed(transfer_methods, write_method) ||
+                !is_listed(transfer_allocations, read_allocation) || !is_listed(transfer_methods, read_method)) {
+                invalid_keys.push_back(key);
+                continue;
+            }
+            m_strategies[key][size] = bp_transfer_choice{
+                { static_cast<bp_allocation>(write_allocation), static_cast<bp_transfer_method>(write_method) },
+                { static_cast<bp_allocation>(read_allocation), static_cast<bp_transfer_method>(read_method) } };
+        }
+    }
+
+    // A device with an invalid entry is probed again.
+    for (const auto& key : invalid_keys) {
+        bp_print_info(true, "Ignore invalid cached transfer strategies of ", key);
+        m_strategies.erase(key);
+    }
+}
+
+void bp_transfer_policy::probe(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue)
+{
+    std::string key = platform::get_device_key(device);
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        if (m_strategies.find(key) != m_strategies.end()) {
+            bp_print_info(true, "Use cached transfer strategies of ", key);
+            return;
+        }
+    }
+
+    // Devices are probed without holding the lock, so workers of other devices can probe at the same time.
+    size_t alignment = std::max<size_t>(TRANSFER_HOST_ALIGNMENT,
+        platform::get_device_info_single_type<cl_uint>(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN) / 8);
+    std::map<size_t, bp_transfer_choice> strategies{};
+    for (auto size : transfer_probe_sizes) {
+        std::vector<char> host_data(size, 1);
+        bp_transfer_choice best{};
+        double best_write = 0.0;
+        double best_read = 0.0;
+        for (auto allocation : transfer_allocations) {
+            // Host pointer buffers wrap the caller's array, so they are written from and read into it in place.
+            bp_memory bp_memory{};
+            bool wraps_host = allocation == bp_allocation::use_host_ptr;
+            std::vector<char> host_storage(wraps_host ? size + alignment : 0, 1);
+            void* aligned_storage = host_storage.data();
+            size_t storage_size = host_storage.size();
+            if (wraps_host) {
+                std::align(alignment, size, aligned_storage, storage_size);
+            }
+            cl_mem buffer = bp_memory.create_buffer(context, CL_MEM_READ_WRITE, size,
+                wraps_host ? aligned_storage : nullptr, allocation);
+            char* host_ptr = wraps_host ? static_cast<char*>(aligned_storage) : host_data.data();
+
+            for (auto method : transfer_methods) {
+                // Each direction is timed on its own, the best of a few runs is taken.
+                std::chrono::nanoseconds write_time{ 0 };
+                std::chrono::nanoseconds read_time{ 0 };
+                for (size_t i = 0; i < TRANSFER_PROBE_REPEAT; ++i) {
+                    auto begin = std::chrono::steady_clock::now();
+                    bp_memory.write_buffer(command_queue, buffer, size, host_ptr, method);
+                    auto middle = std::chrono::steady_clock::now();
+                    bp_memory.read_buffer(command_queue, buffer, size, host_ptr, method);
+                    auto end = std::chrono::steady_clock::now();
+                    auto elapsed_write = std::chrono::duration_cast<std::chrono::nanoseconds>(middle - begin);
+                    auto elapsed_read = std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle);
+                    if (write_time.count() == 0 || elapsed_write < write_time) {
+                        write_time = elapsed_write;
+                    }
+                    if (read_time.count() == 0 || elapsed_read < read_time) {
+                        read_time = elapsed_read;
+                    }
+                }
+
+                double write_throughput = write_time.count() == 0 ? 0.0 : static_cast<double>(size) / write_time.count();
+                double read_throughput = read_time.count() == 0 ? 0.0 : static_cast<double>(size) / read_time.count();
+                bp_print_info(true, "Transfer of ", size, " bytes with ", get_allocation_name(allocation), " and ",
+                    get_transfer_method_name(method), ": write ", write_throughput, " GB/s, read ", read_throughput,
+                    " GB/s");
+                if (write_throughput > best_write) {
+                    best_write = write_throughput;
+                    best.write = bp_transfer_strategy{ allocation, method };
+                }
+                if (read_throughput > best_read) {
+                    best_read = read_throughput;
+                    best.read = bp_transfer_strategy{ allocation, method };
+                }
+            }
+        }
+        strategies[size] = best;
+        bp_print_info(true, "Best write of ", size, " bytes is ", get_allocation_name(best.write.allocation), " with ",
+            get_transfer_method_name(best.write.method), ", best read is ", get_allocation_name(best.read.allocation),
+            " with ", get_transfer_method_name(best.read.method));
+    }
+
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_strategies[key] = strategies;
+    save_cache();
+}
+
+bp_transfer_strategy bp_transfer_policy::choose(gsl::not_null<cl_device_id> device, size_t size,
+    bp_transfer_direction direction) const
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    auto iter = m_strategies.find(platform::get_device_key(device));
+    bp_validate_condition(iter != m_strategies.end() && !iter->second.empty(), "Transfer strategies haven't been probed.");
+
+    // Use the smallest probed size that covers the buffer, or the largest one.
+    auto bucket = iter->second.lower_bound(size);
+    if (bucket == iter->second.end()) {
+        --bucket;
+    }
+    return direction == bp_transfer_direction::write ? bucket->second.write : bucket->second.read;
+}
+
+void bp_transfer_policy::save_cache() const
+{
+    std::ofstream cache_file{ TRANSFER_CACHE_FILE };
+    for (const auto& device_strategies : m_strategies) {
+        for (const auto& size_choice : device_strategies.second) {
+            const auto& choice = size_choice.second;
+            cache_file << device_strategies.first << '\t' << size_choice.first << ' '
+                << static_cast<int>(choice.write.allocation) << ' ' << static_cast<int>(choice.write.method) << ' '
+                << static_cast<int>(choice.read.allocation) << ' ' << static_cast<int>(choice.read.method) << '\n';
+        }
+    }
+}
+}
 }
-}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <map>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <gsl/pointers>
 
@@ -9,24 +12,111 @@
 
 namespace runtime {
 namespace memory {
+// Where the storage of a buffer lives, set by its creation flags.
+enum class bp_allocation {
+    device,
+    alloc_host_ptr,
+    use_host_ptr
+};
+
+// How host data moves into or out of a buffer: clEnqueueWriteBuffer/clEnqueueReadBuffer, or mapping the buffer.
+enum class bp_transfer_method {
+    copy,
+    map
+};
+
+enum class bp_transfer_direction {
+    write,
+    read
+};
+
+struct bp_transfer_strategy {
+    bp_allocation allocation;
+    bp_transfer_method method;
+};
+
+const char* get_allocation_name(bp_allocation);
+
+const char* get_transfer_method_name(bp_transfer_method);
+
+const cl_image_format IMAGE_FORMAT_R_FLOAT{ CL_R, CL_FLOAT };
+const cl_image_format IMAGE_FORMAT_RGBA_FLOAT{ CL_RGBA, CL_FLOAT };
+const cl_image_format IMAGE_FORMAT_RGBA_HALF{ CL_RGBA, CL_HALF_FLOAT };
+const cl_image_format IMAGE_FORMAT_RGBA_UNORM_INT8{ CL_RGBA, CL_UNORM_INT8 };
+const cl_image_format IMAGE_FORMAT_BGRA_UNORM_INT8{ CL_BGRA, CL_UNORM_INT8 };
+const cl_image_format IMAGE_FORMAT_R_UINT32{ CL_R, CL_UNSIGNED_INT32 };
+
+bool is_image_format_supported(gsl::not_null<cl_context>, cl_mem_flags, cl_mem_object_type, const cl_image_format&);
+
 class bp_memory {
 public:
-    bp_memory() : m_memories{} {}
-    ~bp_memory()
-    {
-        for (auto memory : m_memories) {
-            cl_int err = clReleaseMemObject(memory);
-            bp_validate_condition(err == CL_SUCCESS, "Release memory object failed.");
-        }
-    }
+    bp_memory() : m_memories{}, m_samplers{} {}
+    ~bp_memory();
     bp_memory(const bp_memory&) = delete;
     bp_memory& operator=(const bp_memory&) = delete;
     bp_memory(bp_memory&&) = delete;
     bp_memory& operator=(bp_memory&&) = delete;
 
     cl_mem create_buffer(gsl::not_null<cl_context>, cl_mem_flags, size_t, void*);
+
+    // The flags only carry the access mode, the allocation decides where the storage lives.
+    cl_mem create_buffer(gsl::not_null<cl_context>, cl_mem_flags, size_t, void*, bp_allocation);
+
+    // Releases one object before the others, for owners that manage their own lifetimes.
+    void release(gsl::not_null<cl_mem>);
+    void release(gsl::not_null<cl_sampler>);
+
+    void write_buffer(gsl::not_null<cl_command_queue>, gsl::not_null<cl_mem>, size_t, const void*, bp_transfer_method) const;
+
+    void read_buffer(gsl::not_null<cl_command_queue>, gsl::not_null<cl_mem>, size_t, void*, bp_transfer_method) const;
+
+    // Host data, when given, is tightly packed and copied into the image.
+    cl_mem create_image_2d(gsl::not_null<cl_context>, cl_mem_flags, const cl_image_format&, size_t width, size_t height,
+        void* host_ptr);
+
+    cl_mem create_image_3d(gsl::not_null<cl_context>, cl_mem_flags, const cl_image_format&, size_t width, size_t height,
+        size_t depth, void* host_ptr);
+
+    cl_sampler create_sampler(gsl::not_null<cl_context>, bool normalized_coords, cl_addressing_mode, cl_filter_mode);
+
+    // Region is (width, height, depth), with depth 1 for 2D images.
+    void write_image(gsl::not_null<cl_command_queue>, gsl::not_null<cl_mem>, const size_t* region, const void*) const;
+
+    void read_image(gsl::not_null<cl_command_queue>, gsl::not_null<cl_mem>, const size_t* region, void*) const;
 private:
+    cl_mem create_image(gsl::not_null<cl_context>, cl_mem_flags, const cl_image_format&, const cl_image_desc&, void*);
+
     std::vector<cl_mem> m_memories;
+    std::vector<cl_sampler> m_samplers;
+};
+
+// Measures write and read throughput of every allocation with every transfer method at a few sizes, and picks
+// the fastest pair per device, buffer size and direction. Results are cached in a file keyed by device name and
+// driver version. One policy can be shared by the workers of several devices.
+class bp_transfer_policy {
+public:
+    bp_transfer_policy();
+    bp_transfer_policy(const bp_transfer_policy&) = delete;
+    bp_transfer_policy& operator=(const bp_transfer_policy&) = delete;
+    bp_transfer_policy(bp_transfer_policy&&) = delete;
+    bp_transfer_policy& operator=(bp_transfer_policy&&) = delete;
+
+    void probe(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>);
+
+    bp_transfer_strategy choose(gsl::not_null<cl_device_id>, size_t, bp_transfer_direction) const;
+private:
+    struct bp_transfer_choice {
+        bp_transfer_strategy write;
+        bp_transfer_strategy read;
+    };
+
+    // Called with m_mutex held.
+    void save_cache() const;
+
+    mutable std::mutex m_mutex;
+
+    // Device key to (probe size, best strategies), sorted by size.
+    std::map<std::string, std::map<size_t, bp_transfer_choice>> m_strategies;
 };
 }
 }
@@ -0,0 +1,290 @@
+#include "bp_opencl_runtime_precision.h"
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr size_t PRECISION_PROBE_SIZE = 1 << 16;
+constexpr size_t PRECISION_PROBE_REPEAT = 3;
+
+static const std::vector<std::string> native_kernel_funcs{
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "__kernel void double_func(__global const double* in, __global double* out)\n"
+    "{\n"
+    "\tint tid = get_global_id(0);\n"
+    "\tout[tid] = in[tid * 3] * in[tid * 3 + 1] + in[tid * 3 + 2];\n"
+    "}"
+};
+
+static const std::vector<std::string> emulated_kernel_funcs{
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "float2 ds_quick_two_sum(float a, float b)\n"
+    "{\n"
+    "\tfloat s = a + b;\n"
+    "\treturn (float2)(s, b - (s - a));\n"
+    "}\n"
+    "float2 ds_two_sum(float a, float b)\n"
+    "{\n"
+    "\tfloat s = a + b;\n"
+    "\tfloat v = s - a;\n"
+    "\treturn (float2)(s, (a - (s - v)) + (b - v));\n"
+    "}\n"
+    "float2 ds_add(float2 a, float2 b)\n"
+    "{\n"
+    "\tfloat2 s = ds_two_sum(a.x, b.x);\n"
+    "\ts.y += a.y + b.y;\n"
+    "\treturn ds_quick_two_sum(s.x, s.y);\n"
+    "}\n"
+    "float2 ds_mul(float2 a, float2 b)\n"
+    "{\n"
+    "\tfloat p = a.x * b.x;\n"
+    "\tfloat e = fma(a.x, b.x, -p);\n"
+    "\te += a.x * b.y + a.y * b.x;\n"
+    "\treturn ds_quick_two_sum(p, e);\n"
+    "}\n"
+    "__kernel void double_single_func(__global const float2* in, __global float2* out)\n"
+    "{\n"
+    "\tint tid = get_global_id(0);\n"
+    "\tout[tid] = ds_add(ds_mul(in[tid * 3], in[tid * 3 + 1]), in[tid * 3 + 2]);\n"
+    "}",
+    "__kernel void mixed_func(__global const float* in, __global float* out)\n"
+    "{\n"
+    "\tint tid = get_global_id(0);\n"
+    "\tout[tid] = fma(in[tid * 3], in[tid * 3 + 1], in[tid * 3 + 2]);\n"
+    "}"
+};
+
+// Error of each result relative to the magnitude of its terms, so cancellation in a * b + c
+// doesn't inflate the figure.
+static double max_normalized_error(const double* in, const double* out, size_t size)
+{
+    double max_error = 0.0;
+    for (auto i = 0; i < size; ++i) {
+        double a = in[i * 3], b = in[i * 3 + 1], c = in[i * 3 + 2];
+        double scale = std::fabs(a * b) + std::fabs(c);
+        double error = std::fabs(out[i] - std::fma(a, b, c));
+        max_error = std::max(max_error, scale == 0.0 ? error : error / scale);
+    }
+    return max_error;
+}
+
+static std::vector<cl_device_id> get_devices(const platform::bp_device& bp_device)
+{
+    std::vector<cl_device_id> devices{};
+    for (auto i = 0; i < bp_device.get_number(); ++i) {
+        devices.push_back(bp_device.get_ith(i));
+    }
+    return devices;
+}
+
+namespace runtime {
+namespace precision {
+const char* get_precision_mode_name(bp_precision_mode mode)
+{
+    switch (mode) {
+        case bp_precision_mode::native_double:
+            return "native double";
+        case bp_precision_mode::double_single:
+            return "double-single emulation";
+        case bp_precision_mode::mixed:
+            return "mixed precision";
+        default:
+            return "unknown";
+    }
+}
+
+roofline::bp_kernel_cost get_precision_mode_cost(bp_precision_mode mode)
+{
+    // Double-single costs 21 float ops: 10 for ds_mul and 11 for ds_add.
+    switch (mode) {
+        case bp_precision_mode::native_double:
+            return roofline::bp_kernel_cost{ "double_func", sizeof(double) * 4, 2, true };
+        case bp_precision_mode::double_single:
+            return roofline::bp_kernel_cost{ "double_single_func", sizeof(float) * 2 * 4, 21, false };
+        case bp_precision_mode::mixed:
+        default:
+            return roofline::bp_kernel_cost{ "mixed_func", sizeof(float) * 4, 2, false };
+    }
+}
+
+bp_precision_policy::bp_precision_policy(gsl::not_null<cl_context> context, const platform::bp_device& bp_device,
+    double accuracy_budget) : bp_precision_policy{ context, get_devices(bp_device), accuracy_budget }
+{
+}
+
+bp_precision_policy::bp_precision_policy(gsl::not_null<cl_context> context, const std::vector<cl_device_id>& devices,
+    double accuracy_budget) : m_context{ context }, m_accuracy_budget{ accuracy_budget }, m_program{}, m_kernel{},
+    m_cmdqueue{}, m_double_kernel{ nullptr }, m_double_single_kernel{ nullptr }, m_mixed_kernel{ nullptr },
+    m_double_devices{}, m_reports{}
+{
+    for (auto device : devices) {
+        if (device_supports_double(device)) {
+            m_double_devices.push_back(device);
+        }
+    }
+
+    cl_program emulated_program = m_program.create_program_with_source(context, emulated_kernel_funcs, devices);
+    m_double_single_kernel = m_kernel.create_kernel(emulated_program, "double_single_func");
+    m_mixed_kernel = m_kernel.create_kernel(emulated_program, "mixed_func");
+
+    // Building fp64 code fails on devices without it, so the native kernel only targets those that have it.
+    if (!m_double_devices.empty()) {
+        cl_program native_program = m_program.create_program_with_source(context, native_kernel_funcs, m_double_devices);
+        m_double_kernel = m_kernel.create_kernel(native_program, "double_func");
+    }
+}
+
+bool bp_precision_policy::device_supports_double(gsl::not_null<cl_device_id> device)
+{
+    return platform::get_device_info_single_type<cl_device_fp_config>(device, CL_DEVICE_DOUBLE_FP_CONFIG) != 0;
+}
+
+const bp_precision_report& bp_precision_policy::select(gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue)
+{
+    auto iter = m_reports.find(device);
+    if (iter != m_reports.end()) {
+        return iter->second;
+    }
+
+    std::vector<bp_precision_mode> modes{ bp_precision_mode::double_single, bp_precision_mode::mixed };
+    if (std::find(m_double_devices.begin(), m_double_devices.end(), device.get()) != m_double_devices.end()) {
+        modes.insert(modes.begin(), bp_precision_mode::native_double);
+    } else {
+        bp_print_info(true, "Device doesn't support double, native double kernel is skipped.");
+    }
+
+    auto probe_in(std::make_unique<double[]>(PRECISION_PROBE_SIZE * 3));
+    auto probe_out(std::make_unique<double[]>(PRECISION_PROBE_SIZE));
+    fill_random_data<double>(probe_in.get(), PRECISION_PROBE_SIZE * 3, 127.0, -128.0);
+
+    // Pick the fastest variant within budget, or the most accurate one if none fits.
+    std::vector<bp_precision_report> reports{};
+    for (auto mode : modes) {
+        // A warm-up launch keeps the first mode from paying for the device waking up, then the best of a few
+        // runs is taken.
+        run_mode(mode, command_queue, probe_in.get(), probe_out.get(), PRECISION_PROBE_SIZE);
+        cl_ulong elapsed_time = 0;
+        for (size_t i = 0; i < PRECISION_PROBE_REPEAT; ++i) {
+            cl_ulong time = run_mode(mode, command_queue, probe_in.get(), probe_out.get(), PRECISION_PROBE_SIZE);
+            if (i == 0 || time < elapsed_time) {
+                elapsed_time = time;
+            }
+        }
+        double max_error = max_normalized_error(probe_in.get(), probe_out.get(), PRECISION_PROBE_SIZE);
+        bp_print_info(true, "Probe of ", get_precision_mode_name(mode), ": ", elapsed_time, " ns, max error ", max_error);
+        reports.push_back(bp_precision_report{ mode, elapsed_time, max_error });
+    }
+
+    bool found = false;
+    bp_precision_report best = reports.front();
+    for (const auto& report : reports) {
+        if (report.max_error <= m_accuracy_budget) {
+            if (!found || report.elapsed_time < best.elapsed_time) {
+                best = report;
+            }
+            found = true;
+        } else if (!found && report.max_error < best.max_error) {
+            best = report;
+        }
+    }
+    if (!found) {
+        bp_print_info(true, "No precision mode meets accuracy budget ", m_accuracy_budget, ", using the most accurate one.");
+    }
+    bp_print_info(true, "Selected ", get_precision_mode_name(best.mode), " with max error ", best.max_error);
+
+    return m_reports.emplace(device, best).first->second;
+}
+
+bp_precision_report bp_precision_policy::run(gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, const double* in, double* out, size_t size)
+{
+    bp_precision_report report = select(device, command_queue);
+    report.elapsed_time = run_mode(report.mode, command_queue, in, out, size);
+    report.max_error = max_normalized_error(in, out, size);
+    bp_print_info(true, "Ran double kernel with ", get_precision_mode_name(report.mode), ", max error ",
+        report.max_error, " against a host reference");
+    return report;
+}
+
+cl_ulong bp_precision_policy::run_mode(bp_precision_mode mode, gsl::not_null<cl_command_queue> command_queue,
+    const double* in, double* out, size_t size)
+{
+    memory::bp_memory bp_memory{};
+    cl_mem in_mem = nullptr;
+    cl_mem out_mem = nullptr;
+    cl_kernel kernel = nullptr;
+    std::vector<float> in_float{};
+    std::vector<float> out_float{};
+
+    switch (mode) {
+        case bp_precision_mode::native_double:
+            in_mem = bp_memory.create_buffer(m_context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+                sizeof(double) * size * 3, const_cast<double*>(in));
+            out_mem = bp_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, sizeof(double) * size, nullptr);
+            kernel = m_double_kernel;
+            break;
+        case bp_precision_mode::double_single:
+            // Each double becomes a hi/lo float pair whose sum carries about 48 bits of mantissa.
+            in_float.resize(size * 3 * 2);
+            for (auto i = 0; i < size * 3; ++i) {
+                in_float[i * 2] = static_cast<float>(in[i]);
+                in_float[i * 2 + 1] = static_cast<float>(in[i] - static_cast<double>(in_float[i * 2]));
+            }
+            out_float.resize(size * 2);
+            in_mem = bp_memory.create_buffer(m_context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+                sizeof(float) * in_float.size(), in_float.data());
+            out_mem = bp_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, sizeof(float) * out_float.size(), nullptr);
+            kernel = m_double_single_kernel;
+            break;
+        case bp_precision_mode::mixed:
+            in_float.resize(size * 3);
+            for (auto i = 0; i < size * 3; ++i) {
+                in_float[i] = static_cast<float>(in[i]);
+            }
+            out_float.resize(size);
+            in_mem = bp_memory.create_buffer(m_context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_ONLY,
+                sizeof(float) * in_float.size(), in_float.data());
+            out_mem = bp_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, sizeof(float) * out_float.size(), nullptr);
+            kernel = m_mixed_kernel;
+            break;
+    }
+    bp_validate_condition(kernel != nullptr, "Precision mode isn't available on this device.");
+
+    std::pair<cl_mem*, size_t> in_arg(&in_mem, sizeof(cl_mem));
+    std::pair<cl_mem*, size_t> out_arg(&out_mem, sizeof(cl_mem));
+    set_args(kernel, 0, in_arg, out_arg);
+    cl_ulong elapsed_time = m_cmdqueue.enqueue_kernel(command_queue, kernel, size);
+
+    cl_int err;
+    if (mode == bp_precision_mode::native_double) {
+        err = clEnqueueReadBuffer(command_queue, out_mem, CL_TRUE, 0, sizeof(double) * size, out, 0, nullptr, nullptr);
+    } else {
+        err = clEnqueueReadBuffer(command_queue, out_mem, CL_TRUE, 0, sizeof(float) * out_float.size(),
+            out_float.data(), 0, nullptr, nullptr);
+    }
+    bp_validate_condition(err == CL_SUCCESS, "Read buffer failed.");
+
+    if (mode == bp_precision_mode::double_single) {
+        for (auto i = 0; i < size; ++i) {
+            out[i] = static_cast<double>(out_float[i * 2]) + static_cast<double>(out_float[i * 2 + 1]);
+        }
+    } else if (mode == bp_precision_mode::mixed) {
+        for (auto i = 0; i < size; ++i) {
+            out[i] = static_cast<double>(out_float[i]);
+        }
+    }
+
+    return elapsed_time;
+}
+}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_roofline.h"
+
+namespace runtime {
+namespace precision {
+enum class bp_precision_mode {
+    native_double,
+    double_single,
+    mixed
+};
+
+const char* get_precision_mode_name(bp_precision_mode);
+
+roofline::bp_kernel_cost get_precision_mode_cost(bp_precision_mode);
+
+// max_error is measured against a host double reference, on the probe by select() and on the job by run().
+struct bp_precision_report {
+    bp_precision_mode mode;
+    cl_ulong elapsed_time;
+    double max_error;
+};
+
+// Runs the double test kernel (out = a * b + c) with the fastest variant whose measured error fits
+// the accuracy budget. Devices without fp64 or with slow fp64 fall back to double-single emulation
+// (a float2 hi/lo pair per double) or to mixed precision (float compute, double storage).
+class bp_precision_policy {
+public:
+    bp_precision_policy(gsl::not_null<cl_context>, const platform::bp_device&, double accuracy_budget);
+    bp_precision_policy(gsl::not_null<cl_context>, const std::vector<cl_device_id>&, double accuracy_budget);
+    bp_precision_policy(const bp_precision_policy&) = delete;
+    bp_precision_policy& operator=(const bp_precision_policy&) = delete;
+    bp_precision_policy(bp_precision_policy&&) = delete;
+    bp_precision_policy& operator=(bp_precision_policy&&) = delete;
+
+    static bool device_supports_double(gsl::not_null<cl_device_id>);
+
+    const bp_precision_report& select(gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>);
+
+    bp_precision_report run(gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+        const double* in, double* out, size_t size);
+private:
+    cl_ulong run_mode(bp_precision_mode, gsl::not_null<cl_command_queue>, const double* in, double* out, size_t size);
+
+    cl_context m_context;
+    double m_accuracy_budget;
+    bp_program m_program;
+    bp_kernel m_kernel;
+    bp_cmdqueue m_cmdqueue;
+    cl_kernel m_double_kernel;
+    cl_kernel m_double_single_kernel;
+    cl_kernel m_mixed_kernel;
+    std::vector<cl_device_id> m_double_devices;
+    std::map<cl_device_id, bp_precision_report> m_reports;
+};
+}
+}
@@ -0,0 +1,193 @@
+#include "bp_opencl_runtime_residency.h"
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+namespace runtime {
+namespace residency {
+bp_residency_manager::bp_residency_manager(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, cl_ulong budget) :
+    m_context{ context }, m_device{ device }, m_command_queue{ command_queue }, m_memory{}, m_cmdqueue{}, m_buffers{},
+    m_lru{}, m_next_id{ 0 }, m_stats{}
+{
+    m_stats.budget = budget != 0 ? budget :
+        platform::get_device_info_single_type<cl_ulong>(device, CL_DEVICE_GLOBAL_MEM_SIZE);
+    bp_print_info(true, "Residency budget of device is: ", m_stats.budget, " bytes");
+}
+
+bp_residency_manager::bp_resident_buffer& bp_residency_manager::get_buffer(bp_resident_id id)
+{
+    auto iter = m_buffers.find(id);
+    bp_validate_condition(iter != m_buffers.end(), "Unknown resident buffer.");
+    return iter->second;
+}
+
+bp_resident_id bp_residency_manager::create_buffer(cl_mem_flags flags, size_t size, const void* host_ptr)
+{
+    auto max_alloc_size = platform::get_device_info_single_type<cl_ulong>(m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    bp_validate_condition(size != 0 && size <= max_alloc_size && size <= m_stats.budget,
+        "Resident buffer size out of range.");
+
+    // Storage flags are the manager's choice, only the access mode is kept.
+    flags &= CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY;
+    bp_resident_buffer buffer{ flags != 0 ? flags : CL_MEM_READ_WRITE, std::vector<char>(size), nullptr, false, 0,
+        m_lru.end() };
+    if (host_ptr != nullptr) {
+        std::memcpy(buffer.host_copy.data(), host_ptr, size);
+    }
+    bp_resident_id id = m_next_id++;
+    m_buffers.emplace(id, std::move(buffer));
+    return id;
+}
+
+void bp_residency_manager::release_buffer(bp_resident_id id)
+{
+    auto& buffer = get_buffer(id);
+    bp_validate_condition(buffer.pins == 0, "Resident buffer is in use.");
+    if (buffer.memory != nullptr) {
+        m_lru.erase(buffer.lru);
+        m_memory.release(buffer.memory);
+        m_stats.resident_bytes -= buffer.host_copy.size();
+    }
+    m_buffers.erase(id);
+}
+
+void bp_residency_manager::write(bp_resident_id id, const void* host_ptr)
+{
+    auto& buffer = get_buffer(id);
+    std::memcpy(buffer.host_copy.data(), host_ptr, buffer.host_copy.size());
+    if (buffer.memory != nullptr) {
+        m_memory.write_buffer(m_command_queue, buffer.memory, buffer.host_copy.size(), buffer.host_copy.data(),
+            memory::bp_transfer_method::copy);
+        buffer.dirty = false;
+    }
+}
+
+void bp_residency_manager::read(bp_resident_id id, void* host_ptr)
+{
+    auto& buffer = get_buffer(id);
+    if (buffer.dirty) {
+        write_back(buffer);
+    }
+    std::memcpy(host_ptr, buffer.host_copy.data(), buffer.host_copy.size());
+}
+
+void bp_residency_manager::write_back(bp_resident_buffer& buffer)
+{
+    m_memory.read_buffer(m_command_queue, buffer.memory, buffer.host_copy.size(), buffer.host_copy.data(),
+        memory::bp_transfer_method::copy);
+    buffer.dirty = false;
+    ++m_stats.write_backs;
+}
+
+void bp_residency_manager::evict(bp_resident_id id)
+{
+    auto& buffer = get_buffer(id);
+    if (buffer.dirty) {
+        write_back(buffer);
+    }
+    m_lru.erase(buffer.lru);
+    buffer.lru = m_lru.end();
+    m_memory.release(buffer.memory);
+    buffer.memory = nullptr;
+    m_stats.resident_bytes -= buffer.host_copy.size();
+    ++m_stats.evictions;
+}
+
+void bp_residency_manager::make_resident(bp_resident_id id, bool upload)
+{
+    auto& buffer = get_buffer(id);
+    if (buffer.memory != nullptr) {
+        m_lru.splice(m_lru.begin(), m_lru, buffer.lru);
+        return;
+    }
+
+    // The list runs from most to least recently used, pinned buffers belong to the current launch.
+    size_t size = buffer.host_copy.size();
+    while (m_stats.resident_bytes + size > m_stats.budget) {
+        auto victim = std::find_if(m_lru.rbegin(), m_lru.rend(), [this](bp_resident_id resident) {
+            return m_buffers.at(resident).pins == 0;
+        });
+        bp_validate_condition(victim != m_lru.rend(), "Pinned buffers exceed the residency budget.");
+        evict(*victim);
+    }
+
+    buffer.memory = m_memory.create_buffer(m_context, buffer.flags, size, nullptr);
+    if (upload) {
+        m_memory.write_buffer(m_command_queue, buffer.memory, size, buffer.host_copy.data(),
+            memory::bp_transfer_method::copy);
+        ++m_stats.uploads;
+    }
+    buffer.dirty = false;
+    m_lru.push_front(id);
+    buffer.lru = m_lru.begin();
+    m_stats.resident_bytes += size;
+    m_stats.high_water_mark = std::max(m_stats.high_water_mark, m_stats.resident_bytes);
+}
+
+cl_ulong bp_residency_manager::enqueue_kernel(gsl::not_null<cl_kernel> kernel, const bp_ndrange& range,
+    const std::vector<bp_resident_arg>& args)
+{
+    // A buffer is uploaded unless every use of it in this launch is write only and covers all of it.
+    size_t global_items = 1;
+    for (cl_uint i = 0; i < range.work_dim; ++i) {
+        global_items *= range.global_size[i];
+    }
+    std::map<bp_resident_id, bool> uploads{};
+    for (const auto& arg : args) {
+        bool covered = arg.access == bp_access::write_only &&
+            arg.item_size * global_items >= get_buffer(arg.id).host_copy.size();
+        uploads[arg.id] = uploads[arg.id] || !covered;
+    }
+    cl_ulong working_set = 0;
+    for (const auto& upload : uploads) {
+        working_set += get_buffer(upload.first).host_copy.size();
+    }
+    bp_validate_condition(working_set <= m_stats.budget, "Launch working set exceeds the residency budget.");
+
+    // Everything the launch uses is pinned first, so making one buffer resident can't evict another.
+    for (const auto& upload : uploads) {
+        ++get_buffer(upload.first).pins;
+    }
+    for (const auto& upload : uploads) {
+        make_resident(upload.first, upload.second);
+    }
+    for (const auto& arg : args) {
+        cl_mem memory = get_buffer(arg.id).memory;
+        set_arg(kernel, arg.arg_index, memory);
+    }
+
+    cl_ulong elapsed_time = m_cmdqueue.enqueue_kernel(m_command_queue, kernel, range);
+
+    for (const auto& arg : args) {
+        if (arg.access != bp_access::read_only) {
+            get_buffer(arg.id).dirty = true;
+        }
+    }
+    for (const auto& upload : uploads) {
+        --get_buffer(upload.first).pins;
+    }
+    return elapsed_time;
+}
+
+void bp_residency_manager::print_stats() const
+{
+    bp_print_info(true, "Residency budget: ", m_stats.budget, " bytes, resident: ", m_stats.resident_bytes,
+        " bytes, high water mark: ", m_stats.high_water_mark, " bytes");
+    bp_print_info(true, "Residency uploads: ", m_stats.uploads, ", evictions: ", m_stats.evictions,
+        ", write backs: ", m_stats.write_backs);
+}
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+namespace runtime {
+namespace residency {
+using bp_resident_id = size_t;
+
+// Write only buffers are overwritten whole by the kernel, so they aren't uploaded before it runs.
+enum class bp_access {
+    read_only,
+    write_only,
+    read_write
+};
+
+// item_size is the number of bytes every work item writes to a write only buffer. The upload is only skipped
+// when the launch covers the whole buffer with it, otherwise the buffer is uploaded like a read write one.
+struct bp_resident_arg {
+    cl_uint arg_index;
+    bp_resident_id id;
+    bp_access access;
+    size_t item_size = 0;
+};
+
+struct bp_residency_stats {
+    cl_ulong budget;
+    cl_ulong resident_bytes;
+    cl_ulong high_water_mark;
+    size_t uploads;
+    size_t evictions;
+    size_t write_backs;
+};
+
+// Keeps the buffers of one device within a byte budget. Every buffer has a host copy, device storage is
+// created when a launch uses it and released again when room is needed, least recently used first.
+// Buffers the device has written since their last upload are read back before they are evicted.
+class bp_residency_manager {
+public:
+    // A budget of 0 uses CL_DEVICE_GLOBAL_MEM_SIZE.
+    bp_residency_manager(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+        cl_ulong budget = 0);
+    bp_residency_manager(const bp_residency_manager&) = delete;
+    bp_residency_manager& operator=(const bp_residency_manager&) = delete;
+    bp_residency_manager(bp_residency_manager&&) = delete;
+    bp_residency_manager& operator=(bp_residency_manager&&) = delete;
+
+    // Host data, when given, is copied into the host copy, otherwise it starts zeroed.
+    bp_resident_id create_buffer(cl_mem_flags, size_t, const void* host_ptr);
+    void release_buffer(bp_resident_id);
+
+    void write(bp_resident_id, const void*);
+    void read(bp_resident_id, void*);
+
+    // Makes the buffer arguments resident, sets them and runs the kernel. Other arguments are set by the caller.
+    cl_ulong enqueue_kernel(gsl::not_null<cl_kernel>, const bp_ndrange&, const std::vector<bp_resident_arg>&);
+
+    const bp_residency_stats& get_stats() const
+    {
+        return m_stats;
+    }
+
+    void print_stats() const;
+private:
+    struct bp_resident_buffer {
+        cl_mem_flags flags;
+        std::vector<char> host_copy;
+        cl_mem memory;
+        bool dirty;
+        size_t pins;
+        std::list<bp_resident_id>::iterator lru;
+    };
+
+    bp_resident_buffer& get_buffer(bp_resident_id);
+    void make_resident(bp_resident_id, bool upload);
+    void evict(bp_resident_id);
+    void write_back(bp_resident_buffer&);
+
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_command_queue m_command_queue;
+    memory::bp_memory m_memory;
+    bp_cmdqueue m_cmdqueue;
+    std::map<bp_resident_id, bp_resident_buffer> m_buffers;
+    std::list<bp_resident_id> m_lru;
+    bp_resident_id m_next_id;
+    bp_residency_stats m_stats;
+};
+}
+}
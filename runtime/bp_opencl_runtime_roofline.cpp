@@ -0,0 +1,202 @@
+#include "bp_opencl_runtime_roofline.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr size_t STREAM_BENCHMARK_SIZE = 1 << 22;
+constexpr size_t STREAM_BENCHMARK_REPEAT = 5;
+constexpr size_t FMA_BENCHMARK_SIZE = 1 << 20;
+constexpr cl_int FMA_BENCHMARK_ITERATIONS = 256;
+constexpr size_t FMA_BENCHMARK_CHAINS = 8;
+
+static const std::vector<std::string> stream_kernel_funcs{
+    "__kernel void stream_triad(__global float4* a, __global const float4* b, __global const float4* c, float scalar)\n"
+    "{\n"
+    "\tint tid = get_global_id(0);\n"
+    "\ta[tid] = b[tid] + scalar * c[tid];\n"
+    "}"
+};
+
+// Independent FMA chains keep the pipelines full, a and b are arguments so nothing is folded.
+static const std::vector<std::string> fma_kernel_funcs{
+    "#if USE_DOUBLE\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#define REAL double\n"
+    "#else\n"
+    "#define REAL float\n"
+    "#endif\n"
+    "__kernel void fma_peak(__global REAL* out, REAL a, REAL b, int iterations)\n"
+    "{\n"
+    "\tREAL x0 = get_global_id(0);\n"
+    "\tREAL x1 = x0 + 1;\n"
+    "\tREAL x2 = x0 + 2;\n"
+    "\tREAL x3 = x0 + 3;\n"
+    "\tREAL x4 = x0 + 4;\n"
+    "\tREAL x5 = x0 + 5;\n"
+    "\tREAL x6 = x0 + 6;\n"
+    "\tREAL x7 = x0 + 7;\n"
+    "\tfor (int i = 0; i < iterations; ++i) {\n"
+    "\t\tx0 = fma(x0, a, b);\n"
+    "\t\tx1 = fma(x1, a, b);\n"
+    "\t\tx2 = fma(x2, a, b);\n"
+    "\t\tx3 = fma(x3, a, b);\n"
+    "\t\tx4 = fma(x4, a, b);\n"
+    "\t\tx5 = fma(x5, a, b);\n"
+    "\t\tx6 = fma(x6, a, b);\n"
+    "\t\tx7 = fma(x7, a, b);\n"
+    "\t}\n"
+    "\tout[get_global_id(0)] = x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7;\n"
+    "}"
+};
+
+namespace runtime {
+namespace roofline {
+double measure_peak_compute(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, bool is_double)
+{
+    if (is_double &&
+        platform::get_device_info_single_type<cl_device_fp_config>(device, CL_DEVICE_DOUBLE_FP_CONFIG) == 0) {
+        return 0.0;
+    }
+
+    bp_program bp_program{};
+    bp_kernel bp_kernel{};
+    memory::bp_memory bp_memory{};
+    bp_cmdqueue bp_cmdqueue{};
+
+    cl_program program = bp_program.create_program_with_source(context, fma_kernel_funcs,
+        std::vector<cl_device_id>{ device }, is_double ? "-D USE_DOUBLE=1" : "-D USE_DOUBLE=0");
+    cl_kernel kernel = bp_kernel.create_kernel(program, "fma_peak");
+    size_t real_size = is_double ? sizeof(cl_double) : sizeof(cl_float);
+    cl_mem out_mem = bp_memory.create_buffer(context, CL_MEM_WRITE_ONLY, real_size * FMA_BENCHMARK_SIZE, nullptr);
+    cl_double a_double = 0.999;
+    cl_double b_double = 0.001;
+    cl_float a_float = 0.999f;
+    cl_float b_float = 0.001f;
+    cl_int iterations = FMA_BENCHMARK_ITERATIONS;
+    set_arg(kernel, 0, out_mem);
+    set_arg(kernel, 1, real_size, is_double ? static_cast<const void*>(&a_double) : &a_float);
+    set_arg(kernel, 2, real_size, is_double ? static_cast<const void*>(&b_double) : &b_float);
+    set_arg(kernel, 3, sizeof(cl_int), &iterations);
+
+    // The first launch warms up the kernel, the best of the rest is taken.
+    bp_cmdqueue.enqueue_kernel(command_queue, kernel, FMA_BENCHMARK_SIZE);
+    cl_ulong best_time = 0;
+    for (size_t i = 0; i < STREAM_BENCHMARK_REPEAT; ++i) {
+        cl_ulong elapsed_time = bp_cmdqueue.enqueue_kernel(command_queue, kernel, FMA_BENCHMARK_SIZE);
+        if (best_time == 0 || elapsed_time < best_time) {
+            best_time = elapsed_time;
+        }
+    }
+    double flops = 2.0 * FMA_BENCHMARK_ITERATIONS * FMA_BENCHMARK_CHAINS * FMA_BENCHMARK_SIZE;
+    return best_time == 0 ? 0.0 : flops / best_time;
+}
+
+const bp_device_peak& bp_roofline::measure_device_peak(gsl::not_null<cl_context> context,
+    gsl::not_null<cl_device_id> device, gsl::not_null<cl_command_queue> command_queue)
+{
+    auto iter = m_peaks.find(device);
+    if (iter != m_peaks.end()) {
+        return iter->second;
+    }
+
+    bp_program bp_program{};
+    bp_kernel bp_kernel{};
+    memory::bp_memory bp_memory{};
+    bp_cmdqueue bp_cmdqueue{};
+
+    cl_program program = bp_program.create_program_with_source(context, stream_kernel_funcs,
+        std::vector<cl_device_id>{ device });
+    cl_kernel kernel = bp_kernel.create_kernel(program, "stream_triad");
+
+    // Keep the three arrays well within a single allocation and a quarter of global memory.
+    auto max_alloc_size = platform::get_device_info_single_type<cl_ulong>(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    auto global_mem_size = platform::get_device_info_single_type<cl_ulong>(device, CL_DEVICE_GLOBAL_MEM_SIZE);
+    size_t bytes_limit = static_cast<size_t>(std::min(max_alloc_size, global_mem_size / 12));
+    size_t size = std::min(STREAM_BENCHMARK_SIZE, bytes_limit / (sizeof(float) * 4));
+
+    // The inputs are written before they are timed, so no launch reads storage that was never touched.
+    std::vector<float> b(4 * size, 1.0f);
+    std::vector<float> c(4 * size, 2.0f);
+    cl_mem a_mem = bp_memory.create_buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * 4 * size, nullptr);
+    cl_mem b_mem = bp_memory.create_buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * 4 * size,
+        b.data());
+    cl_mem c_mem = bp_memory.create_buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * 4 * size,
+        c.data());
+    cl_float scalar = 3.0f;
+    std::pair<cl_mem*, size_t> a_arg(&a_mem, sizeof(cl_mem));
+    std::pair<cl_mem*, size_t> b_arg(&b_mem, sizeof(cl_mem));
+    std::pair<cl_mem*, size_t> c_arg(&c_mem, sizeof(cl_mem));
+    std::pair<cl_float*, size_t> scalar_arg(&scalar, sizeof(cl_float));
+    set_args(kernel, 0, a_arg, b_arg, c_arg, scalar_arg);
+
+    // The first launch warms up the buffers, the best of the rest is taken.
+    bp_cmdqueue.enqueue_kernel(command_queue, kernel, size);
+    cl_ulong best_time = 0;
+    for (auto i = 0; i < STREAM_BENCHMARK_REPEAT; ++i) {
+        cl_ulong elapsed_time = bp_cmdqueue.enqueue_kernel(command_queue, kernel, size);
+        if (best_time == 0 || elapsed_time < best_time) {
+            best_time = elapsed_time;
+        }
+    }
+
+    bp_device_peak peak{};
+    peak.device_name = platform::get_device_info_string(device, CL_DEVICE_NAME);
+    peak.compute_float = measure_peak_compute(context, device, command_queue, false);
+    peak.compute_double = measure_peak_compute(context, device, command_queue, true);
+    peak.bandwidth = best_time == 0 ? 0.0 : static_cast<double>(sizeof(float) * 4 * size * 3) / best_time;
+
+    bp_print_info(true, "Measured float compute of device is: ", peak.compute_float, " GFLOP/s");
+    bp_print_info(true, "Measured double compute of device is: ", peak.compute_double, " GFLOP/s");
+    bp_print_info(true, "Measured bandwidth of device is: ", peak.bandwidth, " GB/s");
+
+    return m_peaks.emplace(device, peak).first->second;
+}
+
+void bp_roofline::add_sample(gsl::not_null<cl_device_id> device, const bp_kernel_cost& cost, size_t num_elements,
+    cl_ulong elapsed_time)
+{
+    m_samples.push_back(bp_kernel_sample{ device, cost, num_elements, elapsed_time });
+}
+
+void bp_roofline::print_report() const
+{
+    bp_print_info(true, "Roofline report:");
+    for (const auto& sample : m_samples) {
+        auto iter = m_peaks.find(sample.device);
+        bp_validate_condition(iter != m_peaks.end(), "Device peak hasn't been measured.");
+        const bp_device_peak& peak = iter->second;
+
+        double bytes = static_cast<double>(sample.cost.bytes_per_element) * sample.num_elements;
+        double flops = static_cast<double>(sample.cost.flops_per_element) * sample.num_elements;
+        double elapsed_time = sample.elapsed_time == 0 ? 1.0 : static_cast<double>(sample.elapsed_time);
+        double achieved_bandwidth = bytes / elapsed_time;
+        double achieved_compute = flops / elapsed_time;
+        double intensity = bytes == 0.0 ? 0.0 : flops / bytes;
+
+        // Attainable performance is the lower of the compute roof and the bandwidth slope at this intensity.
+        double peak_compute = sample.cost.is_double ? peak.compute_double : peak.compute_float;
+        double roof = std::min(peak_compute, intensity * peak.bandwidth);
+        double percent = 0.0;
+        if (flops == 0.0) {
+            percent = peak.bandwidth == 0.0 ? 0.0 : 100.0 * achieved_bandwidth / peak.bandwidth;
+        } else if (roof > 0.0) {
+            percent = 100.0 * achieved_compute / roof;
+        }
+
+        bp_print_info(true, peak.device_name, ", ", sample.cost.name, ": ", achieved_bandwidth, " GB/s, ",
+            achieved_compute, " GFLOP/s, intensity ", intensity, " FLOP/byte, ", percent, "% of roofline (",
+            intensity * peak.bandwidth < peak_compute ? "memory bound" : "compute bound", ")");
+    }
+}
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+
+namespace runtime {
+namespace roofline {
+struct bp_kernel_cost {
+    std::string name;
+    size_t bytes_per_element;
+    size_t flops_per_element;
+    bool is_double;
+};
+
+struct bp_device_peak {
+    std::string device_name;
+    double compute_float;
+    double compute_double;
+    double bandwidth;
+};
+
+struct bp_kernel_sample {
+    cl_device_id device;
+    bp_kernel_cost cost;
+    size_t num_elements;
+    cl_ulong elapsed_time;
+};
+
+// GFLOP/s measured with an FMA microkernel, 0 for double on devices without fp64. Clock, compute unit and
+// vector width queries can't tell how many ALUs a GPU compute unit has, so the peak is measured instead.
+double measure_peak_compute(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+    bool is_double);
+
+// Combines kernel timings with their declared traffic and flops and with the device peaks, then reports
+// achieved GB/s, GFLOP/s, arithmetic intensity and percent of the roofline bound.
+class bp_roofline {
+public:
+    bp_roofline() : m_peaks{}, m_samples{} {}
+    bp_roofline(const bp_roofline&) = delete;
+    bp_roofline& operator=(const bp_roofline&) = delete;
+    bp_roofline(bp_roofline&&) = delete;
+    bp_roofline& operator=(bp_roofline&&) = delete;
+
+    const bp_device_peak& measure_device_peak(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>,
+        gsl::not_null<cl_command_queue>);
+
+    void add_sample(gsl::not_null<cl_device_id>, const bp_kernel_cost&, size_t num_elements, cl_ulong elapsed_time);
+
+    void print_report() const;
+private:
+    std::map<cl_device_id, bp_device_peak> m_peaks;
+    std::vector<bp_kernel_sample> m_samples;
+};
+}
+}
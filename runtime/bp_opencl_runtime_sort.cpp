@@ -0,0 +1,504 @@
+#include "bp_opencl_runtime_sort.h"
+
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr size_t SORT_LOCAL_SIZE_LIMIT = 256;
+constexpr size_t SORT_GROUPS_PER_COMPUTE_UNIT = 4;
+
+static const std::vector<cl_uint> sort_radix_bits_candidates{ 8, 4 };
+
+static const std::vector<std::string> sort_kernel_funcs{
+    "#define RADIX (1 << RADIX_BITS)\n"
+    "#define RADIX_MASK (RADIX - 1)\n"
+    "#if KEY_FLOAT\n"
+    "#define SORTABLE(k) ((k) ^ (((k) >> 31) ? 0xffffffffu : 0x80000000u))\n"
+    "#else\n"
+    "#define SORTABLE(k) (k)\n"
+    "#endif\n"
+    "#define DIGIT(k, shift) ((uint)((SORTABLE(k) >> (shift)) & RADIX_MASK))\n"
+    "\n"
+    "uint work_group_exclusive_scan(__local uint* scan, uint value, uint* total)\n"
+    "{\n"
+    "\tuint lid = get_local_id(0);\n"
+    "\tuint size = get_local_size(0);\n"
+    "\tscan[lid] = value;\n"
+    "\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\tfor (uint offset = 1; offset < size; offset <<= 1) {\n"
+    "\t\tuint addend = lid >= offset ? scan[lid - offset] : 0;\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\tscan[lid] += addend;\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t}\n"
+    "\tuint inclusive = scan[lid];\n"
+    "\t*total = scan[size - 1];\n"
+    "\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\treturn inclusive - value;\n"
+    "}\n"
+    "\n"
+    "__kernel void radix_histogram(__global const KEY_T* keys, __global uint* histograms, uint shift, ulong count,\n"
+    "\tulong items_per_group, __local uint* local_histogram)\n"
+    "{\n"
+    "\tuint lid = get_local_id(0);\n"
+    "\tuint size = get_local_size(0);\n"
+    "\tuint group = get_group_id(0);\n"
+    "\tuint num_groups = get_num_groups(0);\n"
+    "\tfor (uint d = lid; d < RADIX; d += size) {\n"
+    "\t\tlocal_histogram[d] = 0;\n"
+    "\t}\n"
+    "\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\tulong begin = group * items_per_group;\n"
+    "\tulong end = min(begin + items_per_group, count);\n"
+    "\tfor (ulong i = begin + lid; i < end; i += size) {\n"
+    "\t\tatomic_inc(&local_histogram[DIGIT(keys[i], shift)]);\n"
+    "\t}\n"
+    "\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\tfor (uint d = lid; d < RADIX; d += size) {\n"
+    "\t\thistograms[d * num_groups + group] = local_histogram[d];\n"
+    "\t}\n"
+    "}\n"
+    "\n"
+    "__kernel void radix_scan(__global uint* data, uint length, __local uint* scan)\n"
+    "{\n"
+    "\tuint lid = get_local_id(0);\n"
+    "\tuint chunk = (length + get_local_size(0) - 1) / get_local_size(0);\n"
+    "\tuint begin = min(lid * chunk, length);\n"
+    "\tuint end = min(begin + chunk, length);\n"
+    "\tuint sum = 0;\n"
+    "\tfor (uint i = begin; i < end; ++i) {\n"
+    "\t\tsum += data[i];\n"
+    "\t}\n"
+    "\tuint total;\n"
+    "\tuint running = work_group_exclusive_scan(scan, sum, &total);\n"
+    "\tfor (uint i = begin; i < end; ++i) {\n"
+    "\t\tuint value = data[i];\n"
+    "\t\tdata[i] = running;\n"
+    "\t\trunning += value;\n"
+    "\t}\n"
+    "}\n"
+    "\n"
+    "__kernel void radix_scatter(__global const KEY_T* keys_in, __global KEY_T* keys_out,\n"
+    "\t__global const uint* values_in, __global uint* values_out, __global const uint* histograms,\n"
+    "\tuint shift, ulong count, ulong items_per_group, __local uint* digit_offsets, __local uint* digit_counts,\n"
+    "\t__local uint* digit_starts, __local KEY_T* tile_keys, __local uint* tile_origins, __local uint* tile_values,\n"
+    "\t__local uint* scan)\n"
+    "{\n"
+    "\tuint lid = get_local_id(0);\n"
+    "\tuint size = get_local_size(0);\n"
+    "\tuint group = get_group_id(0);\n"
+    "\tuint num_groups = get_num_groups(0);\n"
+    "\tfor (uint d = lid; d < RADIX; d += size) {\n"
+    "\t\tdigit_offsets[d] = histograms[d * num_groups + group];\n"
+    "\t}\n"
+    "\tulong begin = group * items_per_group;\n"
+    "\tulong end = min(begin + items_per_group, count);\n"
+    "\tfor (ulong tile = begin; tile < end; tile += size) {\n"
+    "\t\tfor (uint d = lid; d < RADIX; d += size) {\n"
+    "\t\t\tdigit_counts[d] = 0;\n"
+    "\t\t}\n"
+    "\t\tuint valid_count = (uint)min((ulong)size, end - tile);\n"
+    "\t\tuint origin = lid;\n"
+    "\t\tKEY_T key = origin < valid_count ? keys_in[tile + lid] : (KEY_T)(-1);\n"
+    "#if HAS_VALUES\n"
+    "\t\tuint value = origin < valid_count ? values_in[tile + lid] : 0;\n"
+    "#endif\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\tif (origin < valid_count) {\n"
+    "\t\t\tatomic_inc(&digit_counts[DIGIT(key, shift)]);\n"
+    "\t\t}\n"
+    "\t\t// Stable sort of the tile by digit, one bit split per round. Padding keeps its place after\n"
+    "\t\t// the valid keys of the same digit.\n"
+    "\t\tfor (uint bit = 0; bit < RADIX_BITS; ++bit) {\n"
+    "\t\t\tuint is_set = (DIGIT(key, shift) >> bit) & 1;\n"
+    "\t\t\tuint total_clear;\n"
+    "\t\t\tuint clear_before = work_group_exclusive_scan(scan, 1 - is_set, &total_clear);\n"
+    "\t\t\tuint position = is_set ? total_clear + lid - clear_before : clear_before;\n"
+    "\t\t\ttile_keys[position] = key;\n"
+    "\t\t\ttile_origins[position] = origin;\n"
+    "#if HAS_VALUES\n"
+    "\t\t\ttile_values[position] = value;\n"
+    "#endif\n"
+    "\t\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\t\tkey = tile_keys[lid];\n"
+    "\t\t\torigin = tile_origins[lid];\n"
+    "#if HAS_VALUES\n"
+    "\t\t\tvalue = tile_values[lid];\n"
+    "#endif\n"
+    "\t\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\t}\n"
+    "\t\tuint digit = DIGIT(key, shift);\n"
+    "\t\tif (lid == 0 || DIGIT(tile_keys[lid - 1], shift) != digit) {\n"
+    "\t\t\tdigit_starts[digit] = lid;\n"
+    "\t\t}\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\tif (origin < valid_count) {\n"
+    "\t\t\tuint position = digit_offsets[digit] + lid - digit_starts[digit];\n"
+    "\t\t\tkeys_out[position] = key;\n"
+    "#if HAS_VALUES\n"
+    "\t\t\tvalues_out[position] = value;\n"
+    "#endif\n"
+    "\t\t}\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t\tfor (uint d = lid; d < RADIX; d += size) {\n"
+    "\t\t\tdigit_offsets[d] += digit_counts[d];\n"
+    "\t\t}\n"
+    "\t\tbarrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\t}\n"
+    "}"
+};
+
+static size_t get_key_size(runtime::sort::bp_sort_key_type key_type)
+{
+    return key_type == runtime::sort::bp_sort_key_type::uint64 ? sizeof(cl_ulong) : sizeof(cl_uint);
+}
+
+// Local memory of the scatter kernel: three digit tables plus the tile of keys, origins, values and scan.
+static size_t get_scatter_local_mem_size(cl_uint radix_bits, size_t local_size, size_t key_size)
+{
+    return sizeof(cl_uint) * 3 * (static_cast<size_t>(1) << radix_bits) +
+        local_size * (key_size + sizeof(cl_uint) * 3);
+}
+
+template<typename T>
+static void set_kernel_arg(gsl::not_null<cl_kernel> kernel, cl_uint index, const T& value)
+{
+    runtime::set_arg(kernel, index, sizeof(T), &value, runtime::get_arg_kind<T>());
+}
+
+static void set_local_kernel_arg(gsl::not_null<cl_kernel> kernel, cl_uint index, size_t size)
+{
+    runtime::set_arg(kernel, index, size, nullptr);
+}
+
+// Sorts chunks on separate threads, then merges neighbouring chunks until one is left.
+static void parallel_host_sort(std::vector<cl_uint>& keys)
+{
+    if (keys.size() < 2) {
+        return;
+    }
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (keys.size() + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads{};
+    for (size_t begin = 0; begin < keys.size(); begin += chunk) {
+        size_t end = std::min(begin + chunk, keys.size());
+        threads.emplace_back([&keys, begin, end]() {
+            std::sort(keys.begin() + begin, keys.begin() + end);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (; chunk < keys.size(); chunk *= 2) {
+        threads.clear();
+        for (size_t begin = 0; begin + chunk < keys.size(); begin += chunk * 2) {
+            size_t end = std::min(begin + chunk * 2, keys.size());
+            threads.emplace_back([&keys, begin, chunk, end]() {
+                std::inplace_merge(keys.begin() + begin, keys.begin() + begin + chunk, keys.begin() + end);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+namespace runtime {
+namespace sort {
+bp_radix_sort::bp_radix_sort(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device) :
+    m_context{ context }, m_device{ device }, m_radix_bits{ sort_radix_bits_candidates.back() }, m_program{},
+    m_kernel{}, m_cmdqueue{}, m_kernels{}
+{
+    // Take the widest digit whose scatter tables fit twice in local memory, so several groups share a unit.
+    auto local_mem_size = platform::get_device_info_single_type<cl_ulong>(device, CL_DEVICE_LOCAL_MEM_SIZE);
+    auto max_work_group_size = platform::get_device_info_single_type<size_t>(device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    size_t local_size = std::min(max_work_group_size, SORT_LOCAL_SIZE_LIMIT);
+    for (auto radix_bits : sort_radix_bits_candidates) {
+        if (get_scatter_local_mem_size(radix_bits, local_size, sizeof(cl_ulong)) * 2 <= local_mem_size) {
+            m_radix_bits = radix_bits;
+            break;
+        }
+    }
+    bp_print_info(true, "Radix sort uses ", m_radix_bits, " bit digits.");
+}
+
+const bp_radix_sort::bp_sort_kernels& bp_radix_sort::get_kernels(bp_sort_key_type key_type, bool has_values)
+{
+    std::string options = "-D RADIX_BITS=" + std::to_string(m_radix_bits) +
+        (key_type == bp_sort_key_type::uint64 ? " -D KEY_T=ulong" : " -D KEY_T=uint") +
+        (key_type == bp_sort_key_type::float32 ? " -D KEY_FLOAT=1" : " -D KEY_FLOAT=0") +
+        (has_values ? " -D HAS_VALUES=1" : " -D HAS_VALUES=0");
+    auto iter = m_kernels.find(options);
+    if (iter != m_kernels.end()) {
+        return iter->second;
+    }
+
+    cl_program program = m_program.create_program_with_source(m_context, sort_kernel_funcs,
+        std::vector<cl_device_id>{ m_device }, options);
+    bp_sort_kernels kernels{};
+    kernels.histogram = m_kernel.create_kernel(program, "radix_histogram");
+    kernels.scan = m_kernel.create_kernel(program, "radix_scan");
+    kernels.scatter = m_kernel.create_kernel(program, "radix_scatter");
+
+    // One work group size serves all three kernels.
+    kernels.local_size = SORT_LOCAL_SIZE_LIMIT;
+    for (auto kernel : { kernels.histogram, kernels.scan, kernels.scatter }) {
+        size_t max_size;
+        cl_int err = clGetKernelWorkGroupInfo(kernel, m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_size,
+            nullptr);
+        bp_validate_condition(err == CL_SUCCESS, "Get kernel work group info failed.");
+        kernels.local_size = std::min(kernels.local_size, max_size);
+    }
+    size_t power_of_two = 1;
+    while (power_of_two * 2 <= kernels.local_size) {
+        power_of_two *= 2;
+    }
+    kernels.local_size = power_of_two;
+
+    return m_kernels.emplace(options, kernels).first->second;
+}
+
+cl_ulong bp_radix_sort::sort(gsl::not_null<cl_command_queue> command_queue, gsl::not_null<cl_mem> keys, cl_mem values,
+    size_t count, bp_sort_key_type key_type)
+{
+    bp_validate_condition(count <= std::numeric_limits<cl_uint>::max(), "Radix sort supports up to 2^32 - 1 keys.");
+    if (count < 2) {
+        return 0;
+    }
+
+    const bp_sort_kernels& kernels = get_kernels(key_type, values != nullptr);
+    size_t local_size = kernels.local_size;
+    size_t key_size = get_key_size(key_type);
+    size_t radix = static_cast<size_t>(1) << m_radix_bits;
+
+    auto compute_units = platform::get_device_info_single_type<cl_uint>(m_device, CL_DEVICE_MAX_COMPUTE_UNITS);
+    size_t num_groups = std::min(compute_units * SORT_GROUPS_PER_COMPUTE_UNIT, (count + local_size - 1) / local_size);
+    cl_ulong items_per_group = (count + num_groups - 1) / num_groups;
+    items_per_group = (items_per_group + local_size - 1) / local_size * local_size;
+
+    memory::bp_memory bp_memory{};
+    cl_mem key_buffers[2] = { keys, bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE, key_size * count, nullptr) };
+    cl_mem value_buffers[2] = { values, nullptr };
+    if (values != nullptr) {
+        value_buffers[1] = bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE, sizeof(cl_uint) * count, nullptr);
+    }
+    cl_mem histograms = bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE, sizeof(cl_uint) * radix * num_groups,
+        nullptr);
+    cl_uint histogram_length = static_cast<cl_uint>(radix * num_groups);
+    cl_ulong count_arg = count;
+
+    bp_ndrange group_range{ 1, { 0, 0, 0 }, { num_groups * local_size, 1, 1 }, { local_size, 1, 1 } };
+    bp_ndrange scan_range{ 1, { 0, 0, 0 }, { local_size, 1, 1 }, { local_size, 1, 1 } };
+
+    // Passes alternate between the two buffers, so an even pass count leaves the result in the caller's buffers.
+    // Every digit width divides both key sizes into an even number of passes.
+    size_t num_passes = (key_size * 8 + m_radix_bits - 1) / m_radix_bits;
+    bp_validate_condition(num_passes % 2 == 0, "Radix sort needs an even number of passes.");
+
+    cl_ulong elapsed_time = 0;
+    size_t source = 0;
+    for (cl_uint shift = 0; shift < key_size * 8; shift += m_radix_bits) {
+        set_kernel_arg(kernels.histogram, 0, key_buffers[source]);
+        set_kernel_arg(kernels.histogram, 1, histograms);
+        set_kernel_arg(kernels.histogram, 2, shift);
+        set_kernel_arg(kernels.histogram, 3, count_arg);
+        set_kernel_arg(kernels.histogram, 4, items_per_group);
+        set_local_kernel_arg(kernels.histogram, 5, sizeof(cl_uint) * radix);
+        elapsed_time += m_cmdqueue.enqueue_kernel(command_queue, kernels.histogram, group_range);
+
+        set_kernel_arg(kernels.scan, 0, histograms);
+        set_kernel_arg(kernels.scan, 1, histogram_length);
+        set_local_kernel_arg(kernels.scan, 2, sizeof(cl_uint) * local_size);
+        elapsed_time += m_cmdqueue.enqueue_kernel(command_queue, kernels.scan, scan_range);
+
+        set_kernel_arg(kernels.scatter, 0, key_buffers[source]);
+        set_kernel_arg(kernels.scatter, 1, key_buffers[1 - source]);
+        set_kernel_arg(kernels.scatter, 2, value_buffers[source]);
+        set_kernel_arg(kernels.scatter, 3, value_buffers[1 - source]);
+        set_kernel_arg(kernels.scatter, 4, histograms);
+        set_kernel_arg(kernels.scatter, 5, shift);
+        set_kernel_arg(kernels.scatter, 6, count_arg);
+        set_kernel_arg(kernels.scatter, 7, items_per_group);
+        set_local_kernel_arg(kernels.scatter, 8, sizeof(cl_uint) * radix);
+        set_local_kernel_arg(kernels.scatter, 9, sizeof(cl_uint) * radix);
+        set_local_kernel_arg(kernels.scatter, 10, sizeof(cl_uint) * radix);
+        set_local_kernel_arg(kernels.scatter, 11, key_size * local_size);
+        set_local_kernel_arg(kernels.scatter, 12, sizeof(cl_uint) * local_size);
+        set_local_kernel_arg(kernels.scatter, 13, sizeof(cl_uint) * local_size);
+        set_local_kernel_arg(kernels.scatter, 14, sizeof(cl_uint) * local_size);
+        elapsed_time += m_cmdqueue.enqueue_kernel(command_queue, kernels.scatter, group_range);
+
+        source = 1 - source;
+    }
+
+    cl_int err = clFinish(command_queue);
+    bp_validate_condition(err == CL_SUCCESS, "Finish command queue failed.");
+
+    return elapsed_time;
+}
+
+cl_ulong bp_radix_sort::sort_host(gsl::not_null<cl_command_queue> command_queue, void* keys, size_t key_size,
+    cl_uint* values, size_t count, bp_sort_key_type key_type)
+{
+    memory::bp_memory bp_memory{};
+    cl_mem key_mem = bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, key_size * count, keys);
+    cl_mem value_mem = nullptr;
+    if (values != nullptr) {
+        value_mem = bp_memory.create_buffer(m_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            sizeof(cl_uint) * count, values);
+    }
+
+    cl_ulong elapsed_time = sort(command_queue, key_mem, value_mem, count, key_type);
+
+    bp_memory.read_buffer(command_queue, key_mem, key_size * count, keys, memory::bp_transfer_method::copy);
+    if (values != nullptr) {
+        bp_memory.read_buffer(command_queue, value_mem, sizeof(cl_uint) * count, values,
+            memory::bp_transfer_method::copy);
+    }
+    return elapsed_time;
+}
+
+cl_ulong bp_radix_sort::sort(gsl::not_null<cl_command_queue> command_queue, cl_uint* keys, cl_uint* values, size_t count)
+{
+    return sort_host(command_queue, keys, sizeof(cl_uint), values, count, bp_sort_key_type::uint32);
+}
+
+cl_ulong bp_radix_sort::sort(gsl::not_null<cl_command_queue> command_queue, cl_ulong* keys, cl_uint* values, size_t count)
+{
+    return sort_host(command_queue, keys, sizeof(cl_ulong), values, count, bp_sort_key_type::uint64);
+}
+
+cl_ulong bp_radix_sort::sort(gsl::not_null<cl_command_queue> command_queue, cl_float* keys, cl_uint* values, size_t count)
+{
+    return sort_host(command_queue, keys, sizeof(cl_float), values, count, bp_sort_key_type::float32);
+}
+
+// The host order the device sorts in. Floats order by their bits, so -0.0 comes before 0.0.
+static cl_uint get_sortable_key(cl_uint key)
+{
+    return key;
+}
+
+static cl_ulong get_sortable_key(cl_ulong key)
+{
+    return key;
+}
+
+static cl_uint get_sortable_key(cl_float key)
+{
+    cl_uint bits = 0;
+    std::memcpy(&bits, &key, sizeof(bits));
+    return bits ^ ((bits >> 31) != 0 ? 0xffffffffu : 0x80000000u);
+}
+
+// Sorts the keys with and without their indices as payload and checks both against std::stable_sort.
+template<typename T>
+static void check_radix_sort(bp_radix_sort& bp_radix_sort, gsl::not_null<cl_command_queue> command_queue,
+    const std::vector<T>& keys, const std::string& name)
+{
+    std::vector<std::pair<T, cl_uint>> reference{};
+    for (size_t i = 0; i < keys.size(); ++i) {
+        reference.emplace_back(keys[i], static_cast<cl_uint>(i));
+    }
+    std::stable_sort(reference.begin(), reference.end(), [](const auto& a, const auto& b) {
+        return get_sortable_key(a.first) < get_sortable_key(b.first);
+    });
+
+    std::vector<T> device_keys = keys;
+    bp_radix_sort.sort(command_queue, device_keys.data(), nullptr, keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bp_validate_condition(get_sortable_key(device_keys[i]) == get_sortable_key(reference[i].first),
+            "Radix sort result of " + name + " keys is wrong.");
+    }
+
+    std::vector<T> payload_keys = keys;
+    std::vector<cl_uint> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<cl_uint>(i);
+    }
+    bp_radix_sort.sort(command_queue, payload_keys.data(), values.data(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bp_validate_condition(get_sortable_key(payload_keys[i]) == get_sortable_key(reference[i].first) &&
+            values[i] == reference[i].second, "Radix sort result of " + name + " keys with values is wrong.");
+    }
+    bp_print_info(true, "Radix sort of ", keys.size(), " ", name, " keys with and without values is correct.");
+}
+
+void benchmark_radix_sort(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, size_t count)
+{
+    std::mt19937 generator{ 0 };
+    std::uniform_int_distribution<cl_uint> distribution{};
+    std::vector<cl_uint> keys(count);
+    for (auto& key : keys) {
+        key = distribution(generator);
+    }
+
+    std::vector<cl_uint> reference = keys;
+    auto begin = std::chrono::steady_clock::now();
+    std::sort(reference.begin(), reference.end());
+    auto std_sort_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+
+    std::vector<cl_uint> parallel_keys = keys;
+    begin = std::chrono::steady_clock::now();
+    parallel_host_sort(parallel_keys);
+    auto parallel_sort_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin);
+    bp_validate_condition(parallel_keys == reference, "Parallel host sort result is wrong.");
+
+    // Device time includes building the kernels on first use and both transfers.
+    bp_radix_sort bp_radix_sort{ context, device };
+    std::vector<cl_uint> device_keys = keys;
+    begin = std::chrono::steady_clock::now();
+    cl_ulong kernel_time = bp_radix_sort.sort(command_queue, device_keys.data(), nullptr, count);
+    auto device_sort_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+    bp_validate_condition(device_keys == reference, "Radix sort result is wrong.");
+
+    bp_print_info(true, "Sort of ", count, " keys, std::sort: ", std_sort_time.count(), " ns");
+    bp_print_info(true, "Sort of ", count, " keys, parallel host sort: ", parallel_sort_time.count(), " ns");
+    bp_print_info(true, "Sort of ", count, " keys, radix sort: ", device_sort_time.count(), " ns, kernels ",
+        kernel_time, " ns");
+
+    // Narrow key ranges give many equal keys, so the payloads also check that every pass is stable.
+    std::uniform_int_distribution<cl_uint> narrow_distribution{ 0, 1023 };
+    std::vector<cl_uint> narrow_keys(count);
+    for (auto& key : narrow_keys) {
+        key = narrow_distribution(generator);
+    }
+    check_radix_sort(bp_radix_sort, command_queue, narrow_keys, "uint32");
+
+    std::uniform_int_distribution<cl_ulong> wide_distribution{};
+    std::uniform_int_distribution<cl_ulong> wide_narrow_distribution{ 0, 1023 };
+    std::vector<cl_ulong> wide_keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        wide_keys[i] = i % 2 == 0 ? wide_distribution(generator) : wide_narrow_distribution(generator) << 40;
+    }
+    check_radix_sort(bp_radix_sort, command_queue, wide_keys, "uint64");
+
+    // Quarter steps between -256 and 256 repeat often, zeros are split between -0.0 and 0.0.
+    std::uniform_int_distribution<int> float_distribution{ -1024, 1024 };
+    std::vector<cl_float> float_keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        float_keys[i] = static_cast<cl_float>(float_distribution(generator)) / 4.0f;
+        if (float_keys[i] == 0.0f && i % 2 == 1) {
+            float_keys[i] = -0.0f;
+        }
+    }
+    check_radix_sort(bp_radix_sort, command_queue, float_keys, "float");
+}
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+
+namespace runtime {
+namespace sort {
+enum class bp_sort_key_type {
+    uint32,
+    uint64,
+    float32
+};
+
+// LSD radix sort on the device. Each pass builds per work group digit histograms in __local memory,
+// scans them on the device and scatters keys (and optional cl_uint payloads) stably into place.
+// The digit width is picked from the local memory of the device.
+class bp_radix_sort {
+public:
+    bp_radix_sort(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>);
+    bp_radix_sort(const bp_radix_sort&) = delete;
+    bp_radix_sort& operator=(const bp_radix_sort&) = delete;
+    bp_radix_sort(bp_radix_sort&&) = delete;
+    bp_radix_sort& operator=(bp_radix_sort&&) = delete;
+
+    cl_uint get_radix_bits() const
+    {
+        return m_radix_bits;
+    }
+
+    // Sorts device buffers in place, values may be null. Returns the summed kernel time in nanoseconds.
+    cl_ulong sort(gsl::not_null<cl_command_queue>, gsl::not_null<cl_mem> keys, cl_mem values, size_t count,
+        bp_sort_key_type);
+
+    cl_ulong sort(gsl::not_null<cl_command_queue>, cl_uint* keys, cl_uint* values, size_t count);
+    cl_ulong sort(gsl::not_null<cl_command_queue>, cl_ulong* keys, cl_uint* values, size_t count);
+    cl_ulong sort(gsl::not_null<cl_command_queue>, cl_float* keys, cl_uint* values, size_t count);
+private:
+    struct bp_sort_kernels {
+        cl_kernel histogram;
+        cl_kernel scan;
+        cl_kernel scatter;
+        size_t local_size;
+    };
+
+    const bp_sort_kernels& get_kernels(bp_sort_key_type, bool has_values);
+
+    cl_ulong sort_host(gsl::not_null<cl_command_queue>, void* keys, size_t key_size, cl_uint* values, size_t count,
+        bp_sort_key_type);
+
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_uint m_radix_bits;
+    bp_program m_program;
+    bp_kernel m_kernel;
+    bp_cmdqueue m_cmdqueue;
+    std::map<std::string, bp_sort_kernels> m_kernels;
+};
+
+// Compares the device sort with std::sort and a threaded host sort on random 32-bit keys, then checks
+// 32-bit, 64-bit and float keys, with and without values, against std::stable_sort.
+void benchmark_radix_sort(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+    size_t count);
+}
+}
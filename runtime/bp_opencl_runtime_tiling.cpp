@@ -0,0 +1,165 @@
+#include "bp_opencl_runtime_tiling.h"
+
+#include <vector>
+#include <algorithm>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "../platform/bp_opencl_platform.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+constexpr size_t TILE_LOCAL_SIZE_LIMIT = 256;
+
+// Tiles use at most this share of global memory, leaving room for other allocations.
+constexpr cl_ulong TILE_GLOBAL_MEM_DIVISOR = 2;
+
+static char* offset_host_ptr(void* host_ptr, size_t item_size, size_t start)
+{
+    return static_cast<char*>(host_ptr) + item_size * start;
+}
+
+namespace runtime {
+namespace tiling {
+bp_tiled_executor::bp_tiled_executor(gsl::not_null<cl_context> context, gsl::not_null<cl_device_id> device,
+    gsl::not_null<cl_command_queue> command_queue, const memory::bp_transfer_policy& transfer_policy) :
+    m_context{ context }, m_device{ device }, m_command_queue{ command_queue }, m_transfer_policy{ transfer_policy },
+    m_cmdqueue{}
+{
+}
+
+size_t bp_tiled_executor::get_local_size(gsl::not_null<cl_kernel> kernel) const
+{
+    size_t multiple;
+    cl_int err = clGetKernelWorkGroupInfo(kernel, m_device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+        sizeof(size_t), &multiple, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get kernel work group info failed.");
+    size_t max_size;
+    err = clGetKernelWorkGroupInfo(kernel, m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_size, nullptr);
+    bp_validate_condition(err == CL_SUCCESS, "Get kernel work group info failed.");
+
+    size_t limit = std::min(max_size, TILE_LOCAL_SIZE_LIMIT);
+    if (multiple == 0 || multiple > limit) {
+        return limit;
+    }
+    return limit / multiple * multiple;
+}
+
+size_t bp_tiled_executor::get_tile_items(gsl::not_null<cl_kernel> kernel, const std::vector<bp_tiled_array>& inputs,
+    const std::vector<bp_tiled_array>& outputs, size_t num_items) const
+{
+    size_t max_item_size = 0;
+    size_t total_item_size = 0;
+    for (const auto* arrays : { &inputs, &outputs }) {
+        for (const auto& array : *arrays) {
+            max_item_size = std::max(max_item_size, array.item_size);
+            total_item_size += array.item_size;
+        }
+    }
+    bp_validate_condition(total_item_size != 0, "Tiled job has no arrays.");
+
+    auto max_alloc_size = platform::get_device_info_single_type<cl_ulong>(m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    auto global_mem_size = platform::get_device_info_single_type<cl_ulong>(m_device, CL_DEVICE_GLOBAL_MEM_SIZE);
+    cl_ulong limit = std::min(max_alloc_size / max_item_size, global_mem_size / TILE_GLOBAL_MEM_DIVISOR / total_item_size);
+    if (num_items <= limit) {
+        return num_items;
+    }
+
+    // Full tiles are kept a multiple of the work group so only the last one is padded.
+    size_t local_size = get_local_size(kernel);
+    size_t tile_items = static_cast<size_t>(limit) / local_size * local_size;
+    bp_validate_condition(tile_items != 0, "Work group doesn't fit in device memory.");
+    return tile_items;
+}
+
+cl_ulong bp_tiled_executor::run(gsl::not_null<cl_kernel> kernel, const std::vector<bp_tiled_array>& inputs,
+    const std::vector<bp_tiled_array>& outputs, size_t num_items) const
+{
+    size_t tile_items = get_tile_items(kernel, inputs, outputs, num_items);
+    size_t local_size = get_local_size(kernel);
+    size_t max_in_size = 0;
+    size_t max_out_size = 0;
+    for (const auto& input : inputs) {
+        max_in_size = std::max(max_in_size, input.item_size);
+    }
+    for (const auto& output : outputs) {
+        max_out_size = std::max(max_out_size, output.item_size);
+    }
+    auto write_strategy = m_transfer_policy.choose(m_device, tile_items * max_in_size,
+        memory::bp_transfer_direction::write);
+    auto read_strategy = m_transfer_policy.choose(m_device, tile_items * max_out_size,
+        memory::bp_transfer_direction::read);
+    bool wrap_inputs = write_strategy.allocation == memory::bp_allocation::use_host_ptr;
+    bool wrap_outputs = read_strategy.allocation == memory::bp_allocation::use_host_ptr;
+    bp_print_info(true, "Run ", num_items, " items in tiles of ", tile_items, ", inputs with ",
+        memory::get_allocation_name(write_strategy.allocation), " and ",
+        memory::get_transfer_method_name(write_strategy.method), ", outputs with ",
+        memory::get_allocation_name(read_strategy.allocation), " and ",
+        memory::get_transfer_method_name(read_strategy.method));
+
+    // Device buffers are reused across tiles, host pointer buffers wrap each tile of the host arrays instead.
+    memory::bp_memory bp_memory{};
+    std::vector<cl_mem> in_mems{};
+    std::vector<cl_mem> out_mems{};
+    if (!wrap_inputs) {
+        for (const auto& input : inputs) {
+            in_mems.push_back(bp_memory.create_buffer(m_context, CL_MEM_READ_ONLY, tile_items * input.item_size,
+                nullptr, write_strategy.allocation));
+        }
+    }
+    if (!wrap_outputs) {
+        for (const auto& output : outputs) {
+            out_mems.push_back(bp_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, tile_items * output.item_size,
+                nullptr, read_strategy.allocation));
+        }
+    }
+
+    cl_ulong elapsed_time = 0;
+    for (size_t start = 0; start < num_items; start += tile_items) {
+        size_t count = std::min(tile_items, num_items - start);
+        memory::bp_memory bp_tile_memory{};
+        if (wrap_inputs) {
+            in_mems.clear();
+            for (const auto& input : inputs) {
+                in_mems.push_back(bp_tile_memory.create_buffer(m_context, CL_MEM_READ_ONLY, count * input.item_size,
+                    offset_host_ptr(input.host_ptr, input.item_size, start), write_strategy.allocation));
+            }
+        }
+        if (wrap_outputs) {
+            out_mems.clear();
+            for (const auto& output : outputs) {
+                out_mems.push_back(bp_tile_memory.create_buffer(m_context, CL_MEM_WRITE_ONLY, count * output.item_size,
+                    offset_host_ptr(output.host_ptr, output.item_size, start), read_strategy.allocation));
+            }
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            bp_memory.write_buffer(m_command_queue, in_mems[i], count * inputs[i].item_size,
+                offset_host_ptr(inputs[i].host_ptr, inputs[i].item_size, start), write_strategy.method);
+        }
+
+        cl_uint arg_index = 0;
+        for (const auto* mems : { &in_mems, &out_mems }) {
+            for (const auto& mem : *mems) {
+                set_arg(kernel, arg_index, mem);
+                ++arg_index;
+            }
+        }
+        cl_ulong count_arg = count;
+        set_arg(kernel, arg_index, sizeof(cl_ulong), &count_arg);
+
+        size_t global_size = (count + local_size - 1) / local_size * local_size;
+        bp_ndrange range{ 1, { start, 0, 0 }, { global_size, 1, 1 }, { local_size, 1, 1 } };
+        elapsed_time += m_cmdqueue.enqueue_kernel(m_command_queue, kernel, range);
+
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            bp_memory.read_buffer(m_command_queue, out_mems[i], count * outputs[i].item_size,
+                offset_host_ptr(outputs[i].host_ptr, outputs[i].item_size, start), read_strategy.method);
+        }
+    }
+
+    return elapsed_time;
+}
+}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <gsl/pointers>
+
+#include "CL/opencl.h"
+
+#include "../utils/bp_opencl_common.h"
+#include "bp_opencl_runtime.h"
+#include "bp_opencl_runtime_memory.h"
+
+namespace runtime {
+namespace tiling {
+// Host array with the bytes it holds per work item.
+struct bp_tiled_array {
+    void* host_ptr;
+    size_t item_size;
+};
+
+// Runs an elementwise kernel over any number of work items. Jobs whose arrays exceed
+// CL_DEVICE_MAX_MEM_ALLOC_SIZE or the global memory budget are split into tiles, each launched with
+// its global offset. The kernel takes (inputs..., outputs..., ulong count), indexes its buffers with
+// get_global_id(0) - get_global_offset(0) and returns early past count, since ranges are padded to the
+// work group multiple.
+class bp_tiled_executor {
+public:
+    bp_tiled_executor(gsl::not_null<cl_context>, gsl::not_null<cl_device_id>, gsl::not_null<cl_command_queue>,
+        const memory::bp_transfer_policy&);
+    bp_tiled_executor(const bp_tiled_executor&) = delete;
+    bp_tiled_executor& operator=(const bp_tiled_executor&) = delete;
+    bp_tiled_executor(bp_tiled_executor&&) = delete;
+    bp_tiled_executor& operator=(bp_tiled_executor&&) = delete;
+
+    size_t get_tile_items(gsl::not_null<cl_kernel>, const std::vector<bp_tiled_array>& inputs,
+        const std::vector<bp_tiled_array>& outputs, size_t num_items) const;
+
+    // Returns the summed kernel time of all tiles in nanoseconds.
+    cl_ulong run(gsl::not_null<cl_kernel>, const std::vector<bp_tiled_array>& inputs,
+        const std::vector<bp_tiled_array>& outputs, size_t num_items) const;
+private:
+    size_t get_local_size(gsl::not_null<cl_kernel>) const;
+
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_command_queue m_command_queue;
+    const memory::bp_transfer_policy& m_transfer_policy;
+    bp_cmdqueue m_cmdqueue;
+};
+}
+}
@@ -1,23 +1,95 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 
 constexpr size_t MAX_STRING_LENGTH = 1024;
 
 constexpr size_t TEST_GLOBAL_SIZE_X = 256;
 
+constexpr size_t TEST_IMAGE_WIDTH = 100;
+
+constexpr size_t TEST_IMAGE_HEIGHT = 60;
+
+constexpr size_t TEST_LOCAL_SIZE_2D = 16;
+
+constexpr const char* TRANSFER_CACHE_FILE = "bp_transfer_cache.txt";
+
+constexpr double DOUBLE_ACCURACY_BUDGET = 1e-12;
+
+constexpr size_t TEST_BATCH_REQUESTS = 32;
+
+constexpr size_t TEST_BATCH_MAX_ITEMS = 4096;
+
+constexpr long long TEST_BATCH_WINDOW_US = 500;
+
+constexpr size_t TEST_SORT_SIZE = 1 << 20;
+
+constexpr size_t TEST_GEMM_SIZE = 1024;
+
+constexpr const char* GEMM_CACHE_FILE = "bp_gemm_cache.txt";
+
+constexpr size_t TEST_RESIDENCY_JOBS = 8;
+
+constexpr size_t TEST_RESIDENCY_ITEMS = 1 << 16;
+
+constexpr size_t TEST_RESIDENCY_BUDGET_JOBS = 3;
+
+constexpr size_t TEST_SCALING_ELEMENTS = 1 << 22;
+
+constexpr size_t TEST_SCALING_CHUNKS = 64;
+
+// Device workers print from several threads, a line is written under one lock.
+inline std::recursive_mutex& get_print_mutex()
+{
+    static std::recursive_mutex print_mutex;
+    return print_mutex;
+}
+
+// A failed condition on a worker thread, reported by the thread that waits for the worker.
+class bp_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Worker threads must not exit the process, they throw bp_error instead.
+inline bool& is_worker_thread()
+{
+    thread_local bool worker_thread = false;
+    return worker_thread;
+}
+
 inline void bp_validate_condition(bool condition, const std::string& message)
 {
     if (!condition) {
+        if (is_worker_thread()) {
+            throw bp_error{ message };
+        }
         std::cout << condition << std::endl;
         std::cout << "Error: " << message << std::endl;
         exit(EXIT_FAILURE);
     }
 }
 
+// Destructors can't throw, so a failed release on a worker thread is printed and the object is leaked.
+inline void bp_validate_release(bool condition, const std::string& message)
+{
+    if (!condition && is_worker_thread()) {
+        std::lock_guard<std::recursive_mutex> lock{ get_print_mutex() };
+        std::cout << "Error: " << message << std::endl;
+        return;
+    }
+    bp_validate_condition(condition, message);
+}
+
 template<typename T, typename ... Types>
 inline void bp_print_info(bool print_head, const T& message, const Types& ... messages)
 {
+    std::lock_guard<std::recursive_mutex> lock{ get_print_mutex() };
     if (print_head) {
         std::cout << "Info: ";
     }
@@ -28,17 +100,21 @@ inline void bp_print_info(bool print_head, const T& message, const Types& ... me
 template<typename T>
 inline void bp_print_info(bool print_head, const T& message)
 {
+    std::lock_guard<std::recursive_mutex> lock{ get_print_mutex() };
     if (print_head) {
         std::cout << "Info: ";
     }
     std::cout << message << std::endl;
 }
 
+// Every call draws the same sequence from its own generator, so workers can fill data at the same time.
 template<typename T>
 void fill_random_data(T* ptr, size_t size, T top, T bottom)
 {
-    srand(0);
-    for (auto i = 0; i < size; ++i) {
-        ptr[i] = bottom + (top - bottom) * static_cast<T>(rand()) / static_cast<T>(RAND_MAX);
+    static_assert(std::is_floating_point<T>::value, "Random data is floating point.");
+    std::mt19937 generator{ 0 };
+    std::uniform_real_distribution<T> distribution{ bottom, top };
+    for (size_t i = 0; i < size; ++i) {
+        ptr[i] = distribution(generator);
     }
 }